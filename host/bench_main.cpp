@@ -0,0 +1,16 @@
+#include <bench/FixedBench.hpp>
+#include <bench/ParseBench.hpp>
+#include <esp_log.h>
+#include <utils/Log.hpp>
+
+// Same suite as the firmware runs with CONFIG_EULER_BENCHMARK, one JSON line
+// per benchmark on stdout
+int main() {
+    esp_log_level_set("*", ESP_LOG_WARN);
+    euler::log::set_level(ESP_LOG_WARN);
+    euler::log::init();
+
+    euler::bench::run_fixed_point();
+    euler::bench::run_parse();
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include <codec/QuatCodec.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Round trips of the tracker sample codec, see codec/QuatCodec.hpp. Every
+// check prints what failed, the exit code is the number of failures.
+using namespace euler;
+using namespace euler::codec;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                  \
+    do {                                                             \
+        if (!(cond)) {                                               \
+            std::printf("%s:%d: check failed: %s\n", __FILE__,       \
+                        __LINE__, #cond);                            \
+            failures++;                                              \
+        }                                                            \
+    } while (0)
+
+struct Sample {
+    uint32_t timestamp;
+    Quat14 rotation;
+};
+
+// Error bound of the header comment: half a quantization step on the sent
+// components, three times that on the recovered one. Both sides are Q14,
+// which adds up to a step of rounding.
+constexpr double HALF_STEP = 0.70710678 / COMPONENT_MAX / 2;
+constexpr double LSB = 1.0 / Quat14::ONE;
+constexpr double SENT_BOUND = HALF_STEP + LSB;
+constexpr double RECOVERED_BOUND = 3 * HALF_STEP + 2 * LSB;
+
+constexpr size_t bits_to_bytes(size_t bits) { return (bits + 7) / 8; }
+
+Quat14 from_axis_angle(double x, double y, double z, double angle) {
+    double norm = std::sqrt(x * x + y * y + z * z);
+    double s = std::sin(angle / 2) / norm;
+    return {fixed::from_float(float(x * s), Quat14::Q),
+            fixed::from_float(float(y * s), Quat14::Q),
+            fixed::from_float(float(z * s), Quat14::Q),
+            fixed::from_float(float(std::cos(angle / 2)), Quat14::Q)};
+}
+
+std::vector<uint8_t> encode(const std::vector<Sample>& samples) {
+    std::vector<uint8_t> buf(samples.size() * KEYFRAME_BITS / 8 + 8);
+    Encoder encoder{buf};
+    for (const Sample& sample : samples)
+        CHECK(encoder.add(sample.timestamp, sample.rotation));
+    buf.resize(encoder.bytes());
+    return buf;
+}
+
+std::vector<Sample> decode(std::span<const uint8_t> buf) {
+    std::vector<Sample> samples;
+    Decoder decoder{buf};
+    Sample sample;
+    while (decoder.next(sample.timestamp, sample.rotation))
+        samples.push_back(sample);
+    return samples;
+}
+
+// Largest error of a decoded rotation, on the component the encoder
+// dropped and on the others, q and -q being the same rotation
+void rotation_error(Quat14 expected, Quat14 actual, double& sent,
+                    double& recovered) {
+    double e[4] = {double(expected.x), double(expected.y), double(expected.z),
+                   double(expected.w)};
+    double a[4] = {double(actual.x), double(actual.y), double(actual.z),
+                   double(actual.w)};
+    uint8_t index = Packed::pack(expected).index;
+    double sign = e[index] < 0 ? -1 : 1;
+
+    sent = 0;
+    recovered = 0;
+    for (int i = 0; i < 4; i++) {
+        double error = std::abs(sign * e[i] - a[i]) * LSB;
+        if (i == index) {
+            recovered = error;
+        } else {
+            sent = std::max(sent, error);
+        }
+    }
+}
+
+void check_round_trip(const std::vector<Sample>& samples) {
+    std::vector<uint8_t> buf = encode(samples);
+    std::vector<Sample> decoded = decode(buf);
+
+    CHECK(decoded.size() == samples.size());
+    for (size_t i = 0; i < std::min(decoded.size(), samples.size()); i++) {
+        CHECK(decoded[i].timestamp == samples[i].timestamp);
+
+        double sent, recovered;
+        rotation_error(samples[i].rotation, decoded[i].rotation, sent,
+                       recovered);
+        CHECK(sent <= SENT_BOUND);
+        CHECK(recovered <= RECOVERED_BOUND);
+    }
+}
+
+// Quaternion whose quantized components are exactly the given ones
+Quat14 quantized(uint8_t index, int16_t a, int16_t b, int16_t c) {
+    Packed packed{.index = index, .values = {a, b, c}};
+    Quat14 q = packed.unpack();
+    CHECK(Packed::pack(q) == packed);
+    return q;
+}
+
+// Size of a two sample stream, tells whether the second one was a delta
+size_t pair_bytes(Sample first, Sample second) {
+    return encode({first, second}).size();
+}
+
+constexpr size_t DELTA_PAIR = (KEYFRAME_BITS + DELTA_FRAME_BITS + 7) / 8;
+constexpr size_t KEYFRAME_PAIR = (2 * KEYFRAME_BITS + 7) / 8;
+
+void test_smooth_stream() {
+    // A head turning at a radian per second, sampled at 1 kHz
+    constexpr uint32_t COUNT = 1000;
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < COUNT; i++) {
+        samples.push_back(
+            {.timestamp = 1'000'000 + i * 1000,
+             .rotation = from_axis_angle(0.3, -0.5, 0.8, i * 0.001)});
+    }
+    check_round_trip(samples);
+
+    // Deltas, keyframes only where forced
+    size_t keyframes = (COUNT + KEYFRAME_INTERVAL - 1) / KEYFRAME_INTERVAL;
+    size_t bits =
+        keyframes * KEYFRAME_BITS + (COUNT - keyframes) * DELTA_FRAME_BITS;
+    CHECK(encode(samples).size() == bits_to_bytes(bits));
+}
+
+void test_delta_boundaries() {
+    Quat14 origin = quantized(3, 0, 0, 0);
+    Sample first{.timestamp = 0, .rotation = origin};
+    int32_t max_delta = (1 << (DELTA_BITS - 1)) - 1;
+
+    for (int sign : {1, -1}) {
+        int16_t within = int16_t(sign * max_delta);
+        int16_t beyond = int16_t(sign * (max_delta + 1));
+
+        CHECK(pair_bytes(first, {100, quantized(3, within, 0, 0)}) ==
+              DELTA_PAIR);
+        CHECK(pair_bytes(first, {100, quantized(3, 0, 0, within)}) ==
+              DELTA_PAIR);
+        CHECK(pair_bytes(first, {100, quantized(3, beyond, 0, 0)}) ==
+              KEYFRAME_PAIR);
+        CHECK(pair_bytes(first, {100, quantized(3, 0, beyond, 0)}) ==
+              KEYFRAME_PAIR);
+
+        check_round_trip({first, {100, quantized(3, within, within, 0)}});
+        check_round_trip({first, {100, quantized(3, 0, beyond, beyond)}});
+    }
+}
+
+void test_keyframe_interval() {
+    // Nothing moves, only the forced keyframes break the deltas
+    constexpr uint32_t COUNT = 3 * KEYFRAME_INTERVAL + 1;
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < COUNT; i++)
+        samples.push_back({.timestamp = i * 1000,
+                           .rotation = from_axis_angle(1, 0, 0, 0.5)});
+
+    size_t keyframes = 4;
+    size_t bits =
+        keyframes * KEYFRAME_BITS + (COUNT - keyframes) * DELTA_FRAME_BITS;
+    CHECK(encode(samples).size() == bits_to_bytes(bits));
+    check_round_trip(samples);
+}
+
+void test_long_gaps() {
+    Quat14 q = from_axis_angle(0, 1, 0, 1.0);
+    uint32_t max_dt = (1u << DT_BITS) - 1;
+
+    CHECK(pair_bytes({0, q}, {max_dt, q}) == DELTA_PAIR);
+    CHECK(pair_bytes({0, q}, {max_dt + 1, q}) == KEYFRAME_PAIR);
+    CHECK(pair_bytes({0, q}, {10'000'000, q}) == KEYFRAME_PAIR);
+
+    // Timestamps wrap around like the microsecond clock they come from
+    check_round_trip({{0, q},
+                      {max_dt, q},
+                      {max_dt + 1 + max_dt, q},
+                      {max_dt + 1 + max_dt + max_dt + 1, q},
+                      {UINT32_MAX - 10, q},
+                      {5, q},
+                      {5 + max_dt + 1, q}});
+}
+
+void test_index_change() {
+    // Turning about x past 90 degrees, the largest component moves from w
+    // to x
+    Quat14 before = from_axis_angle(1, 0, 0, 1.5);
+    Quat14 after = from_axis_angle(1, 0, 0, 1.65);
+    CHECK(Packed::pack(before).index == 3);
+    CHECK(Packed::pack(after).index == 0);
+
+    CHECK(pair_bytes({0, before}, {1000, after}) == KEYFRAME_PAIR);
+    check_round_trip({{0, before}, {1000, after}, {2000, before}});
+
+    // The sign of the dropped component doesn't matter
+    check_round_trip({{0, after}, {1000, after.negated()}});
+    CHECK(pair_bytes({0, after}, {1000, after.negated()}) == DELTA_PAIR);
+}
+
+void test_error_bound() {
+    // Random orientations, each one far enough from the last to be a keyframe
+    std::mt19937 rng{1};
+    std::normal_distribution<double> normal;
+    std::vector<Sample> samples;
+    double max_sent = 0, max_recovered = 0;
+    for (uint32_t i = 0; i < 20'000; i++) {
+        double c[4] = {normal(rng), normal(rng), normal(rng), normal(rng)};
+        double norm =
+            std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2] + c[3] * c[3]);
+        Quat14 q = {fixed::from_float(float(c[0] / norm), Quat14::Q),
+                    fixed::from_float(float(c[1] / norm), Quat14::Q),
+                    fixed::from_float(float(c[2] / norm), Quat14::Q),
+                    fixed::from_float(float(c[3] / norm), Quat14::Q)};
+        samples.push_back({.timestamp = i * 10'000, .rotation = q});
+
+        double sent, recovered;
+        rotation_error(q, Packed::pack(q).unpack(), sent, recovered);
+        max_sent = std::max(max_sent, sent);
+        max_recovered = std::max(max_recovered, recovered);
+    }
+
+    std::printf("max error: %.2e sent, %.2e recovered\n", max_sent,
+                max_recovered);
+    CHECK(max_sent <= SENT_BOUND);
+    CHECK(max_recovered <= RECOVERED_BOUND);
+    check_round_trip(samples);
+}
+
+// Copies the stream from a bit offset on, as a receiver that missed the
+// start would see it
+std::vector<uint8_t> tail_from(std::span<const uint8_t> buf, size_t offset) {
+    BitReader reader{buf};
+    for (size_t i = 0; i < offset; i++) reader.read(1);
+
+    size_t bits = buf.size() * 8 - offset;
+    std::vector<uint8_t> tail(bits_to_bytes(bits));
+    BitWriter writer{tail};
+    for (size_t i = 0; i < bits; i++) writer.write(reader.read(1), 1);
+    return tail;
+}
+
+void test_join_later() {
+    constexpr uint32_t COUNT = 3 * KEYFRAME_INTERVAL;
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < COUNT; i++) {
+        samples.push_back(
+            {.timestamp = 500 + i * 2000,
+             .rotation = from_axis_angle(-0.2, 0.9, 0.1, i * 0.01)});
+    }
+    std::vector<uint8_t> buf = encode(samples);
+    std::vector<Sample> full = decode(buf);
+    CHECK(full.size() == COUNT);
+
+    // Joining at the second forced keyframe gives the same samples from there
+    size_t offset =
+        KEYFRAME_BITS + (KEYFRAME_INTERVAL - 1) * DELTA_FRAME_BITS;
+    std::vector<Sample> joined = decode(tail_from(buf, offset));
+    CHECK(joined.size() == COUNT - KEYFRAME_INTERVAL);
+    for (size_t i = 0; i < joined.size() && i + KEYFRAME_INTERVAL < COUNT;
+         i++) {
+        const Sample& expected = full[i + KEYFRAME_INTERVAL];
+        CHECK(joined[i].timestamp == expected.timestamp);
+        CHECK(Packed::pack(joined[i].rotation) ==
+              Packed::pack(expected.rotation));
+    }
+
+    // A stream picked up on a delta frame can't be decoded
+    CHECK(decode(tail_from(buf, KEYFRAME_BITS)).empty());
+}
+
+void test_full_buffer() {
+    // A sample that doesn't fit leaves the stream as it was
+    std::array<uint8_t, bits_to_bytes(KEYFRAME_BITS + DELTA_FRAME_BITS)> buf{};
+    Encoder encoder{buf};
+    Quat14 q = from_axis_angle(0, 0, 1, 0.2);
+    CHECK(encoder.add(0, q));
+    CHECK(encoder.add(1000, q));
+    CHECK(!encoder.add(2000, q));
+    CHECK(encoder.samples() == 2);
+    CHECK(decode(buf).size() == 2);
+}
+
+}  // namespace
+
+int main() {
+    test_smooth_stream();
+    test_delta_boundaries();
+    test_keyframe_interval();
+    test_long_gaps();
+    test_index_change();
+    test_error_bound();
+    test_join_later();
+    test_full_buffer();
+
+    std::printf("%s, %d failures\n", failures == 0 ? "passed" : "FAILED",
+                failures);
+    return failures;
+}
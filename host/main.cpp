@@ -0,0 +1,271 @@
+#include <drivers/Bno08x.hpp>
+#include <drivers/Bno08xCapture.hpp>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <hwmapping.hpp>
+#include <sim/SimBno08x.hpp>
+#include <utils/Boot.hpp>
+#include <utils/Log.hpp>
+#include <utils/Tasklet.hpp>
+#include <utils/Trace.hpp>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Runs the Bno08x driver against the simulated device and reports what came
+// out of it, exits with an error if the stream was broken:
+//   euler_sim [--seconds=N] [--rate-hz=N] [--batch-us=N] [--girv]
+//             [--jitter-us=N] [--drift-ppm=N] [--drop=N] [--nack=N]
+//             [--corrupt=N] [--moving-ms=N] [--still-ms=N] [--adaptive]
+//             [--suspend-ms=N] [--seed=N] [--capture=FILE] [--verbose]
+// Fault rates are in parts per thousand. The head pauses for --still-ms every
+// --moving-ms, --adaptive slows the stream down during the pauses like the
+// firmware does. --suspend-ms suspends the device that long at the end and
+// measures how long the first sample takes after resuming it. The traffic can
+// be captured to a file for euler_replay.
+
+using namespace euler;
+
+namespace {
+
+struct Options {
+    uint32_t seconds = 5;
+    uint32_t rate_hz = 1000;
+    uint32_t batch_us = 0;
+    uint32_t suspend_ms = 0;
+    bool girv = false;
+    bool adaptive = false;
+    bool verbose = false;
+    std::string capture;
+    sim::SimBno08x::Config sim{.intr = hwmapping::BNO_IRQ,
+                               .reset = hwmapping::BNO_RESET};
+};
+
+// Counts what a consumer of the sample ring sees
+struct Consumer {
+    Bno08x::Samples::Reader reader;
+    Tasklet task;
+
+    uint64_t samples = 0;
+    uint64_t non_monotonic = 0;
+    int64_t first = 0;
+    int64_t last = 0;
+
+    explicit Consumer(const Bno08x::Samples& samples) : reader{samples} {}
+
+    void run() {
+        while (true) {
+            xTaskNotifyWait(0, 1, nullptr, portMAX_DELAY);
+
+            Bno08x::Sample sample;
+            while (reader.pop(sample)) {
+                if (samples == 0) first = sample.timestamp;
+                if (samples > 0 && sample.timestamp <= last) non_monotonic++;
+                last = sample.timestamp;
+                samples++;
+            }
+        }
+    }
+};
+
+bool parse(Options& options, std::string_view arg) {
+    auto value = [&](std::string_view name, auto& out) {
+        if (!arg.starts_with(name) || arg.size() <= name.size() ||
+            arg[name.size()] != '=')
+            return false;
+
+        out = std::strtol(arg.data() + name.size() + 1, nullptr, 0);
+        return true;
+    };
+
+    if (arg == "--girv") return options.girv = true;
+    if (arg == "--adaptive") return options.adaptive = true;
+    if (arg == "--verbose") return options.verbose = true;
+    if (arg.starts_with("--capture=")) {
+        options.capture = arg.substr(std::strlen("--capture="));
+        return !options.capture.empty();
+    }
+
+    return value("--seconds", options.seconds) ||
+           value("--rate-hz", options.rate_hz) ||
+           value("--batch-us", options.batch_us) ||
+           value("--suspend-ms", options.suspend_ms) ||
+           value("--jitter-us", options.sim.jitter_us) ||
+           value("--drift-ppm", options.sim.drift_ppm) ||
+           value("--drop", options.sim.drop_permille) ||
+           value("--nack", options.sim.nack_permille) ||
+           value("--corrupt", options.sim.corrupt_permille) ||
+           value("--moving-ms", options.sim.moving_ms) ||
+           value("--still-ms", options.sim.still_ms) ||
+           value("--seed", options.sim.seed);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (!parse(options, argv[i])) {
+            std::fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    // The driver logs every cargo at the debug level
+    esp_log_level_t level = options.verbose ? ESP_LOG_DEBUG : ESP_LOG_WARN;
+    esp_log_level_set("*", level);
+    // Stack and CPU use of the tasks, at the end of the run
+    esp_log_level_set("Tasklet", std::max(level, ESP_LOG_INFO));
+    log::set_level(level);
+    log::init();
+
+    i2c_master_bus_config_t bus_config = {};
+    bus_config.sda_io_num = hwmapping::I2C_SDA;
+    bus_config.scl_io_num = hwmapping::I2C_SCL;
+    bus_config.trans_queue_depth = 4;
+    i2c_master_bus_handle_t bus;
+    if (i2c_new_master_bus(&bus_config, &bus) != ESP_OK) return 1;
+
+    // Tasks keep running until the process exits, nothing is ever destroyed
+    auto* device = new sim::SimBno08x{options.sim};
+    auto* bno08x = new Bno08x;
+
+    std::FILE* capture = nullptr;
+    if (!options.capture.empty()) {
+        capture = std::fopen(options.capture.c_str(), "wb");
+        if (capture == nullptr) {
+            std::fprintf(stderr, "Failed to open %s\n",
+                         options.capture.c_str());
+            return 1;
+        }
+
+        // Written from the service task, the file is flushed on exit
+        std::fwrite(bno08x::CAPTURE_MAGIC.data(), 1,
+                    bno08x::CAPTURE_MAGIC.size(), capture);
+        bno08x->set_capture([capture, writer = bno08x::CaptureWriter{}](
+                                const bno08x::CaptureRecord& record) mutable {
+            auto header = writer.header(record);
+            std::fwrite(header.data(), 1, header.size(), capture);
+            std::fwrite(record.data.data(), 1, record.data.size(), capture);
+        });
+    }
+
+    if (!device->attach(bus) ||
+        !bno08x->init(bus, hwmapping::BNO_IRQ, hwmapping::BNO_RESET,
+                      hwmapping::BNO_BOOTN)) {
+        std::fprintf(stderr, "Failed to set up the device\n");
+        return 1;
+    }
+
+    auto* consumer = new Consumer{bno08x->samples()};
+    consumer->task.start("Consumer", 4 * 1024, Priority::Stream,
+                         [consumer]() { consumer->run(); });
+    bno08x->add_listener(consumer->task.handle(), 1);
+
+    // Queued together like the firmware does, the feature goes out as soon as
+    // the device is up
+    uint32_t interval = 1'000'000 / options.rate_hz;
+    int64_t boot_start = esp_timer_get_time();
+    Bno08x::Future started = bno08x->start();
+    Bno08x::Future streaming =
+        options.girv ? bno08x->enable_gyro_integrated_rotation_vector(interval)
+                     : bno08x->enable_arvr_stabilized_rotation_vector(
+                           interval, options.batch_us);
+    bool ok = started.wait(pdMS_TO_TICKS(3000)) &&
+              streaming.wait(pdMS_TO_TICKS(1000));
+    if (!ok) {
+        std::fprintf(stderr, "Failed to start streaming\n");
+        return 1;
+    }
+
+    int64_t boot_time = esp_timer_get_time() - boot_start;
+
+    // Same settings as the firmware defaults
+    bno08x::AdaptiveRate::Config rate{.still_interval = 200'000,
+                                      .still_batch_interval = 500'000,
+                                      .settle_time = 1'000'000,
+                                      .classifier_interval = 100'000};
+    if (options.adaptive &&
+        !bno08x->enable_adaptive_rate(rate).wait(pdMS_TO_TICKS(1000))) {
+        std::fprintf(stderr, "Failed to enable the adaptive rate\n");
+        return 1;
+    }
+
+    // Only measure the steady state
+    vTaskDelay(pdMS_TO_TICKS(200));
+    auto ready = boot::time(boot::Phase::ImuReady);
+    auto first_sample = boot::time(boot::Phase::FirstSample);
+    trace::reset();
+    uint64_t start_samples = consumer->samples;
+    int64_t start_timestamp = consumer->last;
+    int64_t start = esp_timer_get_time();
+
+    vTaskDelay(pdMS_TO_TICKS(options.seconds * 1000));
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    uint64_t samples = consumer->samples - start_samples;
+    sim::SimBno08x::Stats stats = device->stats();
+
+    std::printf("samples: %" PRIu64 " (%.1f Hz), lost by the reader: %" PRIu32
+                ", non monotonic: %" PRIu64 "\n",
+                samples, samples * 1e6 / elapsed,
+                consumer->reader.overruns(), consumer->non_monotonic);
+    std::printf("device: %" PRIu64 " reports, %" PRIu64 " cargos, %" PRIu64
+                " dropped, %" PRIu64 " nacked, %" PRIu64 " corrupted\n",
+                stats.reports, stats.cargos, stats.dropped, stats.nacked,
+                stats.corrupted);
+    if (samples > 1)
+        std::printf("mean period: %.2f us\n",
+                    double(consumer->last - start_timestamp) / samples);
+    if (auto drift = bno08x->clock_drift_ppm())
+        std::printf("clock drift: %" PRId32 " ppm\n", *drift);
+    if (ready && first_sample)
+        std::printf("boot: device up after %" PRId64 " us, first sample after "
+                    "%" PRId64 " us\n",
+                    *ready - boot_start, *first_sample - boot_start);
+
+    for (size_t i = 0; i < trace::STAGE_COUNT; i++) {
+        auto stage = trace::Stage(i);
+        trace::Summary summary = trace::summary(stage);
+        if (summary.count == 0) continue;
+
+        std::printf("%-8s n=%-7" PRIu32 " p50=%" PRIu32 "us p99=%" PRIu32
+                    "us max=%" PRIu32 "us\n",
+                    trace::stage_name(stage), summary.count, summary.p50,
+                    summary.p99, summary.max);
+    }
+    Tasklet::dump();
+
+    bool resumed = true;
+    if (options.suspend_ms != 0) {
+        Bno08x::Snapshot snapshot;
+        resumed = bno08x->suspend().wait(pdMS_TO_TICKS(1000));
+        if (resumed) snapshot = bno08x->snapshot();
+
+        vTaskDelay(pdMS_TO_TICKS(options.suspend_ms));
+        uint64_t asleep_samples = consumer->samples;
+
+        int64_t wake = esp_timer_get_time();
+        resumed = resumed && bno08x->resume(snapshot).wait(pdMS_TO_TICKS(1000));
+        while (resumed && consumer->samples == asleep_samples &&
+               esp_timer_get_time() - wake < 1'000'000)
+            vTaskDelay(1);
+
+        int64_t first_sample = esp_timer_get_time() - wake;
+        resumed = resumed && consumer->samples != asleep_samples;
+        std::printf("resume: %s, first sample after %" PRId64
+                    " us, start took %" PRId64 " us\n",
+                    resumed ? "ok" : "failed", first_sample, boot_time);
+    }
+
+    std::fflush(stdout);
+    if (capture != nullptr) std::fflush(capture);
+    bool healthy = samples > 0 && consumer->non_monotonic == 0 && resumed;
+    // Skip destructors, the tasks are still using everything
+    std::_Exit(healthy ? 0 : 1);
+}
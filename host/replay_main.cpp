@@ -0,0 +1,160 @@
+#include <drivers/Bno08x.hpp>
+#include <drivers/Bno08xReplay.hpp>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <utils/Log.hpp>
+#include <utils/Trace.hpp>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+// Feeds a capture of the SHTP traffic, from the firmware or euler_sim, through
+// the Bno08x driver and reports what came out of it:
+//   euler_replay FILE [--speed=N] [--samples] [--verbose]
+// Samples are timestamped with the recorded interrupts, so --samples prints
+// the same output on every run. The speed is a multiple of real time, zero
+// replays as fast as possible.
+
+using namespace euler;
+
+namespace {
+
+struct Options {
+    const char* path = nullptr;
+    uint32_t speed = 0;
+    bool samples = false;
+    bool verbose = false;
+};
+
+// Counts, and optionally prints, what a consumer of the sample ring sees
+struct Consumer {
+    Bno08x::Samples::Reader reader;
+    Tasklet task;
+    bool print;
+
+    uint64_t samples = 0;
+    uint64_t non_monotonic = 0;
+    int64_t last = 0;
+
+    Consumer(const Bno08x::Samples& samples, bool print)
+        : reader{samples}, print{print} {}
+
+    void run() {
+        while (true) {
+            xTaskNotifyWait(0, 1, nullptr, portMAX_DELAY);
+
+            Bno08x::Sample sample;
+            while (reader.pop(sample)) {
+                if (samples > 0 && sample.timestamp <= last) non_monotonic++;
+                last = sample.timestamp;
+                samples++;
+
+                if (print) {
+                    std::printf("%" PRId64 " %d %d %d %d %d %d\n",
+                                sample.timestamp, int(sample.source),
+                                sample.rotation.x, sample.rotation.y,
+                                sample.rotation.z, sample.rotation.w,
+                                sample.accuracy);
+                }
+            }
+        }
+    }
+};
+
+bool parse(Options& options, std::string_view arg) {
+    if (arg == "--samples") return options.samples = true;
+    if (arg == "--verbose") return options.verbose = true;
+    if (arg.starts_with("--speed=")) {
+        options.speed = std::strtoul(arg.data() + std::strlen("--speed="),
+                                     nullptr, 0);
+        return true;
+    }
+
+    if (arg.starts_with("--") || options.path != nullptr) return false;
+    options.path = arg.data();
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (!parse(options, argv[i])) {
+            std::fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (options.path == nullptr) {
+        std::fprintf(stderr, "No capture given\n");
+        return 2;
+    }
+
+    std::ifstream file{options.path, std::ios::binary};
+    if (!file) {
+        std::fprintf(stderr, "Failed to open %s\n", options.path);
+        return 1;
+    }
+
+    std::vector<uint8_t> capture{std::istreambuf_iterator<char>{file}, {}};
+
+    esp_log_level_t level = options.verbose ? ESP_LOG_DEBUG : ESP_LOG_WARN;
+    esp_log_level_set("*", level);
+    log::set_level(level);
+    log::init();
+
+    // Tasks keep running until the process exits, nothing is ever destroyed
+    auto* replay = new bno08x::Replay{capture, options.speed};
+    auto* bno08x = new Bno08x;
+    auto* consumer = new Consumer{bno08x->samples(), options.samples};
+    consumer->task.start("Consumer", 4 * 1024, Priority::Stream,
+                         [consumer]() { consumer->run(); });
+    bno08x->add_listener(consumer->task.handle(), 1);
+
+    int64_t start = esp_timer_get_time();
+    if (!bno08x->init(*replay)) return 1;
+
+    while (!replay->finished()) vTaskDelay(pdMS_TO_TICKS(10));
+    // Let the service task handle the last cargo and the consumer catch up
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    bno08x::Replay::Stats stats = replay->stats();
+
+    std::fprintf(stderr,
+                 "replayed: %" PRIu32 " reads, %" PRIu32 " failed, %" PRIu32
+                 " lost by the recorder, in %.3f s\n",
+                 stats.reads, stats.errors, stats.lost, elapsed / 1e6);
+    std::fprintf(stderr,
+                 "samples: %" PRIu64 ", lost by the reader: %" PRIu32
+                 ", non monotonic: %" PRIu64 "\n",
+                 consumer->samples, consumer->reader.overruns(),
+                 consumer->non_monotonic);
+    if (auto drift = bno08x->clock_drift_ppm())
+        std::fprintf(stderr, "clock drift: %" PRId32 " ppm\n", *drift);
+
+    for (size_t i = 0; i < trace::STAGE_COUNT; i++) {
+        auto stage = trace::Stage(i);
+        trace::Summary summary = trace::summary(stage);
+        if (summary.count == 0) continue;
+
+        std::fprintf(stderr,
+                     "%-8s n=%-7" PRIu32 " p50=%" PRIu32 "us p99=%" PRIu32
+                     "us max=%" PRIu32 "us\n",
+                     trace::stage_name(stage), summary.count, summary.p50,
+                     summary.p99, summary.max);
+    }
+
+    std::fflush(stdout);
+    // A reader overrun makes the output depend on the scheduling
+    bool complete = stats.reads > 0 && consumer->reader.overruns() == 0;
+    // Skip destructors, the tasks are still using everything
+    std::_Exit(complete ? 0 : 1);
+}
@@ -0,0 +1,85 @@
+#include <esp_cpu.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_rom_sys.h>
+#include <esp_timer.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static const Clock::time_point START = Clock::now();
+
+static std::mutex log_mutex;
+static esp_log_level_t default_level = ESP_LOG_INFO;
+static std::map<std::string, esp_log_level_t> tag_levels;
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                                 START)
+        .count();
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+uint32_t esp_cpu_get_cycle_count() {
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     Clock::now() - START)
+                     .count();
+    return uint32_t(ns * esp_rom_get_cpu_ticks_per_us() / 1000);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    std::lock_guard lock{log_mutex};
+
+    if (std::string{tag} == "*") {
+        default_level = level;
+        tag_levels.clear();
+    } else {
+        tag_levels[tag] = level;
+    }
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+    std::lock_guard lock{log_mutex};
+
+    auto it = tag_levels.find(tag);
+    return it != tag_levels.end() ? it->second : default_level;
+}
+
+uint32_t esp_log_timestamp() { return esp_timer_get_time() / 1000; }
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format,
+                   ...) {
+    std::lock_guard lock{log_mutex};
+
+    auto it = tag_levels.find(tag);
+    if (level > (it != tag_levels.end() ? it->second : default_level)) return;
+
+    // Logs go to stderr, stdout is left for reports
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg,
+                             const char *name, esp_pm_lock_handle_t *handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
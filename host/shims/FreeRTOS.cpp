@@ -0,0 +1,273 @@
+#include <freertos/FreeRTOS.h>
+#include <pthread.h>
+
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct tskTaskControlBlock {
+    std::string name;
+    UBaseType_t priority = 0;
+    // CPU time clock of the thread, once it started
+    std::atomic<bool> has_clock{false};
+    clockid_t clock;
+
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t value = 0;
+    bool pending = false;
+};
+
+struct QueueDefinition {
+    size_t length;
+    size_t item_size;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static const Clock::time_point START = Clock::now();
+
+// Threads that were not created through xTaskCreate, like main(), get a
+// control block the first time they need one
+static thread_local TaskHandle_t current_task = nullptr;
+
+// Waits on a condition for a number of ticks, portMAX_DELAY waits forever
+template <typename Predicate>
+static bool wait_for(std::condition_variable &cv,
+                     std::unique_lock<std::mutex> &lock, TickType_t timeout,
+                     Predicate predicate) {
+    if (timeout == portMAX_DELAY) {
+        cv.wait(lock, predicate);
+        return true;
+    }
+
+    return cv.wait_for(lock, std::chrono::milliseconds(timeout), predicate);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack,
+                       void *arg, UBaseType_t priority, TaskHandle_t *task) {
+    TaskHandle_t handle = new tskTaskControlBlock;
+    handle->name = name;
+    handle->priority = priority;
+
+    // Publish the handle before the task gets to run, a higher priority task
+    // would preempt the creator on the target anyway
+    if (task != nullptr) *task = handle;
+
+    std::thread{[=]() {
+        current_task = handle;
+        if (pthread_getcpuclockid(pthread_self(), &handle->clock) == 0)
+            handle->has_clock.store(true);
+        func(arg);
+    }}.detach();
+
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *task,
+                                   BaseType_t core) {
+    return xTaskCreate(func, name, stack, arg, priority, task);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t func,
+                                           const char *name, uint32_t stack,
+                                           void *arg, UBaseType_t priority,
+                                           StackType_t *stack_buffer,
+                                           StaticTask_t *task_buffer,
+                                           BaseType_t core) {
+    TaskHandle_t task = nullptr;
+    xTaskCreate(func, name, stack, arg, priority, &task);
+    return task;
+}
+
+uint32_t ulTaskGetRunTimeCounter(TaskHandle_t task) {
+    if (task == nullptr) task = xTaskGetCurrentTaskHandle();
+    if (!task->has_clock.load()) return 0;
+
+    timespec time;
+    if (clock_gettime(task->clock, &time) != 0) return 0;
+    return uint32_t(time.tv_sec * 1'000'000ll + time.tv_nsec / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (current_task == nullptr) {
+        current_task = new tskTaskControlBlock;
+        current_task->name = "main";
+    }
+
+    return current_task;
+}
+
+const char *pcTaskGetName(TaskHandle_t task) {
+    if (task == nullptr) task = xTaskGetCurrentTaskHandle();
+    return task->name.c_str();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                                 START)
+        .count();
+}
+
+void vTaskSetTimeOutState(TimeOut_t *timer) {
+    timer->entered = xTaskGetTickCount();
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timer, TickType_t *remaining) {
+    if (*remaining == portMAX_DELAY) return pdFALSE;
+
+    TickType_t now = xTaskGetTickCount();
+    TickType_t elapsed = now - timer->entered;
+    if (elapsed >= *remaining) {
+        *remaining = 0;
+        return pdTRUE;
+    }
+
+    *remaining -= elapsed;
+    timer->entered = now;
+    return pdFALSE;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value,
+                       eNotifyAction action) {
+    {
+        std::lock_guard lock{task->mutex};
+
+        switch (action) {
+            case eNoAction:
+                break;
+            case eSetBits:
+                task->value |= value;
+                break;
+            case eIncrement:
+                task->value++;
+                break;
+            case eSetValueWithOverwrite:
+                task->value = value;
+                break;
+        }
+
+        task->pending = true;
+    }
+
+    task->notified.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value,
+                              eNotifyAction action, BaseType_t *woken) {
+    if (woken != nullptr) *woken = pdFALSE;
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+                           uint32_t *value, TickType_t timeout) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    std::unique_lock lock{task->mutex};
+
+    if (!task->pending) task->value &= ~clear_on_entry;
+
+    if (!wait_for(task->notified, lock, timeout,
+                  [task]() { return task->pending; }))
+        return pdFALSE;
+
+    if (value != nullptr) *value = task->value;
+    task->value &= ~clear_on_exit;
+    task->pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    std::unique_lock lock{task->mutex};
+
+    wait_for(task->notified, lock, timeout,
+             [task]() { return task->value != 0; });
+
+    uint32_t value = task->value;
+    if (value != 0) task->value = clear ? 0 : value - 1;
+    task->pending = false;
+    return value;
+}
+
+uint32_t ulTaskNotifyValueClear(TaskHandle_t task, uint32_t bits) {
+    if (task == nullptr) task = xTaskGetCurrentTaskHandle();
+    std::lock_guard lock{task->mutex};
+
+    uint32_t value = task->value;
+    task->value &= ~bits;
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t queue = new QueueDefinition;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size,
+                                 uint8_t *storage, StaticQueue_t *buffer) {
+    return xQueueCreate(length, item_size);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item,
+                      TickType_t timeout) {
+    {
+        std::unique_lock lock{queue->mutex};
+        if (!wait_for(queue->changed, lock, timeout, [queue]() {
+                return queue->items.size() < queue->length;
+            }))
+            return pdFALSE;
+
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(item);
+        queue->items.emplace_back(bytes, bytes + queue->item_size);
+    }
+
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) {
+    {
+        std::unique_lock lock{queue->mutex};
+        if (!wait_for(queue->changed, lock, timeout,
+                      [queue]() { return !queue->items.empty(); }))
+            return pdFALSE;
+
+        if (queue->item_size > 0)
+            std::memcpy(item, queue->items.front().data(), queue->item_size);
+        queue->items.pop_front();
+    }
+
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+    return xQueueCreate(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+    return xQueueReceive(semaphore, nullptr, timeout);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return xQueueSend(semaphore, nullptr, 0);
+}
@@ -0,0 +1,177 @@
+#include <driver/gpio.h>
+
+#include <array>
+#include <mutex>
+
+namespace {
+
+struct Pin {
+    gpio_mode_t mode = GPIO_MODE_DISABLE;
+    gpio_int_type_t intr_type = GPIO_INTR_DISABLE;
+    bool intr_enabled = true;
+    bool held = false;
+    uint32_t level = 0;
+
+    gpio_isr_t handler = nullptr;
+    void *handler_arg = nullptr;
+    gpio_host_watch_t watch = nullptr;
+    void *watch_arg = nullptr;
+};
+
+}  // namespace
+
+static std::mutex mutex;
+static std::array<Pin, GPIO_NUM_MAX> pins;
+
+static bool valid(gpio_num_t pin) { return pin >= 0 && pin < GPIO_NUM_MAX; }
+
+// Level interrupts fire as long as the level holds, handlers are expected to
+// disable them like on the target, so firing once per change is enough
+static bool level_matches(const Pin &state) {
+    return (state.intr_type == GPIO_INTR_LOW_LEVEL && state.level == 0) ||
+           (state.intr_type == GPIO_INTR_HIGH_LEVEL && state.level == 1);
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    std::lock_guard lock{mutex};
+
+    for (size_t i = 0; i < pins.size(); i++) {
+        if (!(config->pin_bit_mask & (uint64_t(1) << i))) continue;
+
+        pins[i].mode = config->mode;
+        pins[i].intr_type = config->intr_type;
+        // Inputs nobody drives float to their pull
+        if (config->mode == GPIO_MODE_INPUT)
+            pins[i].level = config->pull_up_en == GPIO_PULLUP_ENABLE;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) {
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+
+    gpio_host_watch_t watch;
+    void *arg;
+    {
+        std::lock_guard lock{mutex};
+        // The pad keeps its level until released
+        if (pins[pin].held) return ESP_OK;
+
+        pins[pin].level = level != 0;
+        watch = pins[pin].watch;
+        arg = pins[pin].watch_arg;
+    }
+
+    // Outside the lock, the device on the other end may drive pins back
+    if (watch != nullptr) watch(pin, level != 0, arg);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin) {
+    if (!valid(pin)) return 0;
+
+    std::lock_guard lock{mutex};
+    return pins[pin].level;
+}
+
+esp_err_t gpio_install_isr_service(int flags) { return ESP_OK; }
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void *arg) {
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard lock{mutex};
+    pins[pin].handler = handler;
+    pins[pin].handler_arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t pin) {
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+
+    gpio_isr_t handler = nullptr;
+    void *arg = nullptr;
+    {
+        std::lock_guard lock{mutex};
+        Pin &state = pins[pin];
+
+        bool was_enabled = state.intr_enabled;
+        state.intr_enabled = true;
+        if (!was_enabled && level_matches(state)) {
+            handler = state.handler;
+            arg = state.handler_arg;
+        }
+    }
+
+    if (handler != nullptr) handler(arg);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t pin) {
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard lock{mutex};
+    pins[pin].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t intr_type) {
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+    if (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL)
+        return ESP_ERR_INVALID_ARG;
+    return ESP_OK;
+}
+
+esp_err_t gpio_hold_en(gpio_num_t pin) {
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard lock{mutex};
+    pins[pin].held = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_hold_dis(gpio_num_t pin) {
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard lock{mutex};
+    pins[pin].held = false;
+    return ESP_OK;
+}
+
+void gpio_host_drive(gpio_num_t pin, uint32_t level) {
+    if (!valid(pin)) return;
+
+    gpio_isr_t handler = nullptr;
+    void *arg = nullptr;
+    {
+        std::lock_guard lock{mutex};
+        Pin &state = pins[pin];
+
+        level = level != 0;
+        bool rising = state.level == 0 && level == 1;
+        bool falling = state.level == 1 && level == 0;
+        state.level = level;
+
+        bool fire = (state.intr_type == GPIO_INTR_POSEDGE && rising) ||
+                    (state.intr_type == GPIO_INTR_NEGEDGE && falling) ||
+                    (state.intr_type == GPIO_INTR_ANYEDGE &&
+                     (rising || falling)) ||
+                    ((rising || falling) && level_matches(state));
+        fire = fire && state.intr_enabled;
+        if (fire) {
+            handler = state.handler;
+            arg = state.handler_arg;
+        }
+    }
+
+    // The "ISR" runs on the driving thread
+    if (handler != nullptr) handler(arg);
+}
+
+void gpio_host_watch(gpio_num_t pin, gpio_host_watch_t watch, void *arg) {
+    if (!valid(pin)) return;
+
+    std::lock_guard lock{mutex};
+    pins[pin].watch = watch;
+    pins[pin].watch_arg = arg;
+}
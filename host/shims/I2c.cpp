@@ -0,0 +1,108 @@
+#include <driver/i2c_master.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+struct i2c_master_bus_t {
+    i2c_master_bus_config_t config;
+
+    // Serializes transfers, like the bus does
+    std::mutex mutex;
+    std::map<uint16_t, i2c_host_device_t> devices;
+};
+
+struct i2c_master_dev_t {
+    i2c_master_bus_t *bus;
+    i2c_device_config_t config;
+
+    i2c_master_callback_t on_trans_done = nullptr;
+    void *arg = nullptr;
+};
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *config,
+                             i2c_master_bus_handle_t *bus) {
+    *bus = new i2c_master_bus_t{.config = *config, .mutex = {}, .devices = {}};
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus,
+                                    const i2c_device_config_t *config,
+                                    i2c_master_dev_handle_t *dev) {
+    if (config->scl_speed_hz == 0) return ESP_ERR_INVALID_ARG;
+
+    *dev = new i2c_master_dev_t{.bus = bus, .config = *config};
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_register_event_callbacks(
+    i2c_master_dev_handle_t dev, const i2c_master_event_callbacks_t *callbacks,
+    void *arg) {
+    // Callbacks are only meaningful for asynchronous transfers
+    if (dev->bus->config.trans_queue_depth == 0) return ESP_ERR_INVALID_STATE;
+
+    dev->on_trans_done = callbacks->on_trans_done;
+    dev->arg = arg;
+    return ESP_OK;
+}
+
+template <typename Transfer>
+static esp_err_t run(i2c_master_dev_handle_t dev, size_t len,
+                     Transfer transfer) {
+    esp_err_t err;
+    {
+        std::lock_guard lock{dev->bus->mutex};
+
+        // Start, address and every byte take 9 clocks each
+        auto duration = std::chrono::nanoseconds(
+            (len + 1) * 9 * 1'000'000'000ull / dev->config.scl_speed_hz);
+        std::this_thread::sleep_for(duration);
+
+        auto it = dev->bus->devices.find(dev->config.device_address);
+        err = it == dev->bus->devices.end() ? ESP_FAIL : transfer(it->second);
+    }
+
+    if (dev->bus->config.trans_queue_depth == 0)
+        return err == ESP_OK ? ESP_OK : ESP_ERR_INVALID_STATE;
+
+    // Asynchronous transfers always queue fine and report through the
+    // callback, which the target runs from the I2C interrupt
+    if (dev->on_trans_done != nullptr) {
+        i2c_master_event_data_t data{
+            .event = err == ESP_OK ? I2C_EVENT_DONE : I2C_EVENT_NACK};
+        dev->on_trans_done(dev, &data, dev->arg);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *buf,
+                              size_t len, int timeout_ms) {
+    return run(dev, len, [=](const i2c_host_device_t &device) {
+        return device.write(device.ctx, buf, len);
+    });
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t dev, uint8_t *buf,
+                             size_t len, int timeout_ms) {
+    return run(dev, len, [=](const i2c_host_device_t &device) {
+        return device.read(device.ctx, buf, len);
+    });
+}
+
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus) { return ESP_OK; }
+
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus,
+                                       int timeout_ms) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_host_attach(i2c_master_bus_handle_t bus, uint16_t address,
+                          const i2c_host_device_t *device) {
+    std::lock_guard lock{bus->mutex};
+    if (!bus->devices.emplace(address, *device).second)
+        return ESP_ERR_INVALID_STATE;
+
+    return ESP_OK;
+}
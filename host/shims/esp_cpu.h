@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Emulated cycle counter, ticking at esp_rom_get_cpu_ticks_per_us() like the
+// target CPU does. It wraps around just as often as the real one.
+uint32_t esp_cpu_get_cycle_count();
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+// The ESP32-C6 runs at 160MHz
+static inline uint32_t esp_rom_get_cpu_ticks_per_us() { return 160; }
+
+// Busy waits on the target, the thread sleeps here
+void esp_rom_delay_us(uint32_t us);
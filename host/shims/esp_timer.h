@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Microseconds since the process started, on a monotonic clock
+int64_t esp_timer_get_time();
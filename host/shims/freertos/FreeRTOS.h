@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// FreeRTOS API subset backed by host threads. Every task is a thread, so
+// priorities are only recorded and preemption is up to the host scheduler.
+// Ticks are milliseconds.
+
+// Threads have their own stacks, their use isn't tracked
+#define INCLUDE_uxTaskGetStackHighWaterMark 0
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef struct QueueDefinition *QueueHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef uint32_t StackType_t;
+
+typedef struct {
+    TickType_t entered;
+} TimeOut_t;
+
+// Static buffers are accepted for source compatibility, the host allocates
+typedef struct {
+    uint8_t unused;
+} StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef StaticQueue_t StaticTask_t;
+
+typedef enum {
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+} eNotifyAction;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portMAX_DELAY TickType_t(0xffffffffu)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) TickType_t(ms)
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+#define tskNO_AFFINITY 0x7fffffff
+
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
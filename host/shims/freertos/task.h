@@ -0,0 +1,36 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack,
+                       void *arg, UBaseType_t priority, TaskHandle_t *task);
+// There's a single host "core", the affinity is ignored
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *task,
+                                   BaseType_t core);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t func,
+                                           const char *name, uint32_t stack,
+                                           void *arg, UBaseType_t priority,
+                                           StackType_t *stack_buffer,
+                                           StaticTask_t *task_buffer,
+                                           BaseType_t core);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+const char *pcTaskGetName(TaskHandle_t task);
+// CPU time of the thread, in microseconds
+uint32_t ulTaskGetRunTimeCounter(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+void vTaskSetTimeOutState(TimeOut_t *timer);
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timer, TickType_t *remaining);
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value,
+                       eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value,
+                              eNotifyAction action, BaseType_t *woken);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+                           uint32_t *value, TickType_t timeout);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+uint32_t ulTaskNotifyValueClear(TaskHandle_t task, uint32_t bits);
@@ -0,0 +1,5 @@
+#pragma once
+
+// Configuration of the host build
+#define CONFIG_IDF_TARGET "host"
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
@@ -0,0 +1,594 @@
+#include "SimBno08x.hpp"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static const char *TAG = "SimBno08x";
+
+using namespace euler;
+using namespace euler::sim;
+
+// SHTP advertisement tags
+static constexpr uint8_t TAG_MAX_CARGO_WRITE = 2;
+static constexpr uint8_t TAG_MAX_CARGO_READ = 3;
+
+// Faults only hit sensor reports, so that commands complete
+static bool is_sensor(uint8_t chan) {
+    return chan == bno08x::channels::INPUT_SENSOR_REPORTS ||
+           chan == bno08x::channels::GYRO_ROTATION_VECTOR;
+}
+
+static void put_u16(std::vector<uint8_t> &buf, uint16_t value) {
+    buf.push_back(value & 0xff);
+    buf.push_back(value >> 8);
+}
+
+static void put_u32(std::vector<uint8_t> &buf, uint32_t value) {
+    put_u16(buf, value & 0xffff);
+    put_u16(buf, value >> 16);
+}
+
+SimBno08x::SimBno08x(const Config &config)
+    : config{config}, rng{config.seed} {
+    worker = std::thread{[this]() { run(); }};
+}
+
+SimBno08x::~SimBno08x() {
+    {
+        std::lock_guard lock{mutex};
+        running = false;
+    }
+
+    wake.notify_all();
+    worker.join();
+}
+
+bool SimBno08x::attach(i2c_master_bus_handle_t bus) {
+    i2c_host_device_t device{.write = write_cb, .read = read_cb, .ctx = this};
+    if (i2c_host_attach(bus, ADDRESS, &device) != ESP_OK) {
+        ESP_LOGE(TAG, "Address %x is already taken", ADDRESS);
+        return false;
+    }
+
+    gpio_host_watch(config.reset, reset_cb, this);
+    return true;
+}
+
+SimBno08x::Stats SimBno08x::stats() const {
+    std::lock_guard lock{mutex};
+    return counters;
+}
+
+void SimBno08x::run() {
+    std::unique_lock lock{mutex};
+
+    while (running) {
+        int64_t now = esp_timer_get_time();
+        int64_t next = next_event(now);
+        if (next > now) {
+            if (next == INT64_MAX) {
+                wake.wait(lock);
+            } else {
+                wake.wait_for(lock, std::chrono::microseconds(next - now));
+            }
+
+            continue;
+        }
+
+        if (boot_at != 0 && boot_at <= now) boot(now);
+
+        for (Feature *feature : {&arvr, &girv, &classifier}) {
+            while (!asleep && feature->interval_us != 0 &&
+                   sample_time(*feature) <= now) {
+                sample(*feature, sample_time(*feature));
+                feature->count++;
+            }
+        }
+
+        if (!asleep && detector.interval_us != 0 &&
+            moving(now) != detected_moving) {
+            using Report = bno08x::StabilityDetector;
+            detected_moving = !detected_moving;
+            send_stability(detector,
+                           detected_moving ? Report::EXITED_STABLE
+                                           : Report::ENTERED_STABLE,
+                           now);
+        }
+
+        if (!batch.empty() &&
+            (arvr.batch_us == 0 || now - batch.front().time >= arvr.batch_us))
+            flush(now);
+
+        update_intr(false);
+    }
+}
+
+void SimBno08x::boot(int64_t now) {
+    boot_at = 0;
+
+    std::vector<uint8_t> advertisement{0};
+    advertisement.insert(advertisement.end(), {TAG_MAX_CARGO_WRITE, 2});
+    put_u16(advertisement, MAX_CARGO);
+    advertisement.insert(advertisement.end(), {TAG_MAX_CARGO_READ, 2});
+    put_u16(advertisement, MAX_CARGO);
+    send(bno08x::channels::SHTP_COMMAND, advertisement, now);
+
+    // Reset complete
+    send(bno08x::channels::EXECUTABLE, {1}, now);
+}
+
+void SimBno08x::sample(Feature &feature, int64_t time) {
+    Quat14 q = rotation(time);
+    counters.reports++;
+
+    if (&feature == &classifier) {
+        using Classification = bno08x::StabilityClassifier::Classification;
+        send_stability(feature,
+                       uint8_t(moving(time) ? Classification::Motion
+                                            : Classification::Stable),
+                       time);
+        return;
+    }
+
+    if (&feature == &girv) {
+        // Angular velocity is constant, along the rotation axis
+        float angular_speed = moving(time) ? config.angular_speed : 0.0f;
+        int16_t speed = fixed::from_float(angular_speed / 3.0f, 10);
+        std::vector<uint8_t> report;
+        for (int16_t value : {q.x, q.y, q.z, q.w, speed, int16_t(2 * speed),
+                              int16_t(2 * speed)})
+            put_u16(report, value);
+
+        if (!lose(bno08x::channels::GYRO_ROTATION_VECTOR))
+            send(bno08x::channels::GYRO_ROTATION_VECTOR, report,
+                 time + LATENCY_US + jitter());
+        return;
+    }
+
+    // Flush a full batch first, reports can't straddle cargos
+    size_t reports_max = (MAX_CARGO - bno08x::Header::SIZE -
+                          bno08x::BaseTimestampReference::SIZE) /
+                         bno08x::ARVRStabilizedRotationVector::SIZE;
+    if (batch.size() == reports_max) flush(time);
+
+    Pending pending{.time = time,
+                    .sensor_time = int64_t(feature.count * feature.interval_us),
+                    .report = {}};
+    auto &report = pending.report;
+    report[0] = feature.id;
+    report[1] = feature.seq++;
+    // Accuracy high, the delay is filled when the batch is flushed
+    report[2] = 3;
+    bno08x::write_u16(report, 4, q.x);
+    bno08x::write_u16(report, 6, q.y);
+    bno08x::write_u16(report, 8, q.z);
+    bno08x::write_u16(report, 10, q.w);
+    // Heading accuracy of 0.1 rad
+    bno08x::write_u16(report, 12, fixed::from_float(0.1f, 12));
+    batch.push_back(pending);
+}
+
+void SimBno08x::send_stability(Feature &feature, uint8_t value,
+                               int64_t time) {
+    // Unbatched reports deliver the batch waiting in the device with them
+    if (!batch.empty()) flush(time);
+    counters.reports++;
+
+    // Accuracy high and no delay, the value is a single byte on the wire
+    std::vector<uint8_t> payload{bno08x::report_id::BASE_TIMESTAMP, 0, 0, 0,
+                                 0};
+    payload.insert(payload.end(), {feature.id, feature.seq++, 3, 0, value, 0});
+    if (lose(bno08x::channels::INPUT_SENSOR_REPORTS)) return;
+
+    send(bno08x::channels::INPUT_SENSOR_REPORTS, payload,
+         time + LATENCY_US + jitter(), time);
+}
+
+void SimBno08x::flush(int64_t now) {
+    int64_t first = batch.front().time;
+    int64_t last = batch.back().time;
+
+    std::vector<uint8_t> payload{bno08x::report_id::BASE_TIMESTAMP, 0, 0, 0,
+                                 0};
+    for (Pending &pending : batch) {
+        // Delays are measured on the sensor clock, in 100us units
+        int64_t delay =
+            (pending.sensor_time - batch.front().sensor_time) / 100;
+        pending.report[2] |= (delay >> 8) << 2;
+        pending.report[3] = delay & 0xff;
+        payload.insert(payload.end(), pending.report.begin(),
+                       pending.report.end());
+    }
+
+    batch.clear();
+    if (lose(bno08x::channels::INPUT_SENSOR_REPORTS)) return;
+
+    if (chance(config.corrupt_permille)) {
+        // An unknown report id, the driver has to skip the rest of the cargo
+        payload[bno08x::BaseTimestampReference::SIZE] = 0;
+        counters.corrupted++;
+    }
+
+    send(bno08x::channels::INPUT_SENSOR_REPORTS, payload,
+         std::max(now, last) + LATENCY_US + jitter(), first);
+}
+
+int64_t SimBno08x::sample_time(const Feature &feature) const {
+    // Sensor periods last drift_ppm longer on the host clock
+    return feature.start +
+           int64_t(feature.count * feature.interval_us) *
+               (1'000'000 + config.drift_ppm) / 1'000'000;
+}
+
+int64_t SimBno08x::next_event(int64_t now) const {
+    int64_t next = INT64_MAX;
+
+    if (boot_at != 0) next = boot_at;
+
+    for (const Feature *feature : {&arvr, &girv, &classifier}) {
+        if (!asleep && feature->interval_us != 0)
+            next = std::min(next, sample_time(*feature));
+    }
+
+    if (!asleep && detector.interval_us != 0)
+        next = std::min(next, next_transition(now));
+
+    if (!batch.empty() && arvr.batch_us != 0)
+        next = std::min(next, batch.front().time + arvr.batch_us);
+
+    // While the interrupt is asserted the host is the one to act
+    if (!intr_low && current.empty() && !outbox.empty())
+        next = std::min(next, outbox.front().due);
+
+    return next;
+}
+
+Quat14 SimBno08x::rotation(int64_t time) const {
+    // Constant rotation about the (1, 2, 2) / 3 axis
+    float angle = config.angular_speed * float(motion_time(time)) * 1e-6f;
+    float s = std::sin(angle / 2) / 3.0f;
+
+    return {fixed::from_float(s, 14), fixed::from_float(2 * s, 14),
+            fixed::from_float(2 * s, 14),
+            fixed::from_float(std::cos(angle / 2), 14)};
+}
+
+bool SimBno08x::moving(int64_t time) const {
+    if (config.still_ms == 0) return true;
+
+    int64_t period = int64_t(config.moving_ms + config.still_ms) * 1000;
+    return time % period < int64_t(config.moving_ms) * 1000;
+}
+
+int64_t SimBno08x::motion_time(int64_t time) const {
+    if (config.still_ms == 0) return time;
+
+    int64_t period = int64_t(config.moving_ms + config.still_ms) * 1000;
+    int64_t moving = int64_t(config.moving_ms) * 1000;
+    return time / period * moving + std::min(time % period, moving);
+}
+
+int64_t SimBno08x::next_transition(int64_t time) const {
+    if (config.still_ms == 0) return INT64_MAX;
+
+    int64_t period = int64_t(config.moving_ms + config.still_ms) * 1000;
+    int64_t start = time - time % period;
+    int64_t stop = start + int64_t(config.moving_ms) * 1000;
+    return time < stop ? stop : start + period;
+}
+
+esp_err_t SimBno08x::on_write(std::span<const uint8_t> buf) {
+    std::lock_guard lock{mutex};
+
+    if (in_reset || boot_at != 0 || buf.size() < bno08x::Header::SIZE)
+        return ESP_FAIL;
+
+    bno08x::Header header = bno08x::Header::read(buf);
+    if (header.len != buf.size()) {
+        ESP_LOGW(TAG, "Write of %zu bytes with a header length of %d",
+                 buf.size(), header.len);
+        return ESP_OK;
+    }
+
+    if (header.chan == bno08x::channels::SH2_CONTROL &&
+        buf.size() > bno08x::Header::SIZE)
+        on_control(buf.subspan(bno08x::Header::SIZE));
+
+    if (header.chan == bno08x::channels::EXECUTABLE &&
+        buf.size() > bno08x::Header::SIZE)
+        on_executable(buf[bno08x::Header::SIZE]);
+
+    return ESP_OK;
+}
+
+void SimBno08x::on_executable(uint8_t command) {
+    int64_t now = esp_timer_get_time();
+
+    switch (command) {
+        case bno08x::executable::SLEEP:
+            // Samples waiting in the batch are lost
+            asleep = true;
+            batch.clear();
+            break;
+
+        case bno08x::executable::ON:
+            if (!asleep) break;
+
+            // Sensors pick up where they were, after their first period
+            asleep = false;
+            for (Feature *feature : {&arvr, &girv, &classifier}) {
+                feature->start = now + WAKE_TIME_US + feature->interval_us;
+                feature->count = 0;
+            }
+            detected_moving = moving(now);
+            break;
+
+        default:
+            // A reset over the channel isn't simulated
+            break;
+    }
+
+    wake.notify_all();
+}
+
+void SimBno08x::on_control(std::span<const uint8_t> cargo) {
+    int64_t now = esp_timer_get_time();
+
+    switch (cargo[0]) {
+        case bno08x::report_id::SET_FEATURE_COMMAND: {
+            if (cargo.size() < 17) return;
+
+            Feature *feature = nullptr;
+            if (cargo[1] == arvr.id) feature = &arvr;
+            if (cargo[1] == girv.id) feature = &girv;
+            if (cargo[1] == classifier.id) feature = &classifier;
+            if (cargo[1] == detector.id) feature = &detector;
+
+            uint32_t interval = bno08x::read_u32(cargo, 5);
+            uint32_t batch_interval = bno08x::read_u32(cargo, 9);
+            if (feature != nullptr) {
+                if (feature == &arvr) batch.clear();
+                feature->interval_us = interval;
+                feature->batch_us = batch_interval;
+                feature->start = now + interval;
+                feature->count = 0;
+                if (feature == &detector) detected_moving = moving(now);
+            }
+
+            // Unsupported features are reported as disabled
+            if (feature == nullptr) interval = batch_interval = 0;
+
+            std::vector<uint8_t> response{
+                bno08x::report_id::GET_FEATURE_RESPONSE, cargo[1], cargo[2], 0,
+                0};
+            put_u32(response, interval);
+            put_u32(response, batch_interval);
+            put_u32(response, bno08x::read_u32(cargo, 13));
+            send(bno08x::channels::SH2_CONTROL, response, now);
+            break;
+        }
+
+        case bno08x::report_id::FRS_READ_REQUEST: {
+            if (cargo.size() < 8) return;
+
+            using Response = bno08x::FrsReadResponse;
+            uint16_t type = bno08x::read_u16(cargo, 4);
+            bool empty = type != frs_record_type || frs_record.empty();
+            size_t len = empty ? 0 : frs_record.size();
+
+            // Two words per response
+            for (size_t off = 0; off < std::max<size_t>(len, 1); off += 2) {
+                size_t count = std::min<size_t>(len - off, 2);
+                uint8_t status = empty               ? Response::RECORD_EMPTY
+                                 : off + count == len ? Response::READ_COMPLETED
+                                                      : Response::NO_ERROR;
+
+                std::vector<uint8_t> response{
+                    bno08x::report_id::FRS_REQ_RESPONSE,
+                    uint8_t((count << 4) | status)};
+                put_u16(response, off);
+                put_u32(response, count > 0 ? frs_record[off] : 0);
+                put_u32(response, count > 1 ? frs_record[off + 1] : 0);
+                put_u16(response, type);
+                put_u16(response, 0);
+                send(bno08x::channels::SH2_CONTROL, response, now);
+            }
+            break;
+        }
+
+        case bno08x::report_id::FRS_WRITE_REQUEST: {
+            if (cargo.size() < 6) return;
+
+            frs_type = bno08x::read_u16(cargo, 4);
+            frs_words.assign(bno08x::read_u16(cargo, 2), 0);
+
+            std::vector<uint8_t> response{
+                bno08x::report_id::FRS_WRITE_RESPONSE,
+                bno08x::FrsWriteResponse::WRITE_READY};
+            put_u16(response, 0);
+            send(bno08x::channels::SH2_CONTROL, response, now);
+            break;
+        }
+
+        case bno08x::report_id::FRS_WRITE_DATA: {
+            if (cargo.size() < 12) return;
+
+            using Response = bno08x::FrsWriteResponse;
+            uint16_t off = bno08x::read_u16(cargo, 2);
+            for (size_t i = 0; i < 2 && off + i < frs_words.size(); i++)
+                frs_words[off + i] = bno08x::read_u32(cargo, 4 + 4 * i);
+
+            std::vector<uint8_t> response{bno08x::report_id::FRS_WRITE_RESPONSE,
+                                          Response::WORDS_RECEIVED};
+            put_u16(response, off);
+            send(bno08x::channels::SH2_CONTROL, response, now);
+
+            if (off + 2u >= frs_words.size()) {
+                frs_record_type = frs_type;
+                frs_record = frs_words;
+
+                response = {bno08x::report_id::FRS_WRITE_RESPONSE,
+                            Response::WRITE_COMPLETED};
+                put_u16(response, off);
+                send(bno08x::channels::SH2_CONTROL, response, now);
+            }
+            break;
+        }
+
+        default:
+            ESP_LOGW(TAG, "Unsupported control report: %x", cargo[0]);
+            break;
+    }
+}
+
+esp_err_t SimBno08x::on_read(std::span<uint8_t> buf) {
+    std::lock_guard lock{mutex};
+
+    if (in_reset || buf.size() < bno08x::Header::SIZE) return ESP_FAIL;
+
+    int64_t now = esp_timer_get_time();
+    uint8_t chan = !current.empty()  ? current_chan
+                   : !outbox.empty() ? outbox.front().chan
+                                     : bno08x::channels::SHTP_COMMAND;
+    if (is_sensor(chan) && chance(config.nack_permille)) {
+        counters.nacked++;
+        return ESP_FAIL;
+    }
+
+    if (current.empty() && !outbox.empty() && outbox.front().due <= now) {
+        current = std::move(outbox.front().payload);
+        current_chan = outbox.front().chan;
+        current_off = 0;
+        current_started = false;
+        outbox.pop_front();
+    }
+
+    std::fill(buf.begin(), buf.end(), 0);
+    if (current.empty()) {
+        // Nothing to send, an empty header
+        update_intr(true);
+        return ESP_OK;
+    }
+
+    // Whatever doesn't fit in this read is sent again as a continuation,
+    // every transfer has its own sequence number
+    size_t left = current.size() - current_off;
+    uint16_t len = left + bno08x::Header::SIZE;
+    if (current_started) len |= bno08x::Header::CONTINUATION;
+    current_started = true;
+    bno08x::Header::write(
+        {.len = len, .chan = current_chan, .seq = seq_out[current_chan]++},
+        buf);
+
+    size_t count = std::min(buf.size() - bno08x::Header::SIZE, left);
+    std::copy_n(current.begin() + current_off, count,
+                buf.begin() + bno08x::Header::SIZE);
+    current_off += count;
+
+    if (current_off == current.size()) {
+        current.clear();
+        counters.cargos++;
+    }
+
+    update_intr(true);
+    return ESP_OK;
+}
+
+void SimBno08x::on_reset(uint32_t level) {
+    std::lock_guard lock{mutex};
+
+    if (level == 0) {
+        in_reset = true;
+        boot_at = 0;
+        outbox.clear();
+        current.clear();
+        batch.clear();
+        seq_out = {};
+        asleep = false;
+        arvr.interval_us = 0;
+        girv.interval_us = 0;
+        classifier.interval_us = 0;
+        detector.interval_us = 0;
+        update_intr(false);
+    } else if (in_reset) {
+        in_reset = false;
+        boot_at = esp_timer_get_time() + BOOT_TIME_US;
+    }
+
+    wake.notify_all();
+}
+
+void SimBno08x::send(uint8_t chan, std::vector<uint8_t> payload, int64_t due,
+                     std::optional<int64_t> first_sample) {
+    // Cargos are delivered in order
+    if (!outbox.empty()) due = std::max(due, outbox.back().due);
+
+    outbox.push_back({.due = due,
+                      .chan = chan,
+                      .payload = std::move(payload),
+                      .first_sample = first_sample});
+    wake.notify_all();
+}
+
+void SimBno08x::update_intr(bool edge) {
+    int64_t now = esp_timer_get_time();
+    bool ready = !in_reset &&
+                 (!current.empty() ||
+                  (!outbox.empty() && outbox.front().due <= now));
+
+    // The line is released at every read and asserted again for the next one
+    if (edge && intr_low) {
+        gpio_host_drive(config.intr, 1);
+        intr_low = false;
+    }
+
+    if (ready && !intr_low) {
+        if (current.empty() && outbox.front().first_sample.has_value()) {
+            // Base timestamp of the cargo relative to this interrupt
+            Cargo &next = outbox.front();
+            int32_t base_delta = (now - *next.first_sample) / 100;
+            bno08x::write_u32(next.payload, 1, base_delta);
+        }
+
+        gpio_host_drive(config.intr, 0);
+        intr_low = true;
+    } else if (!ready && intr_low) {
+        gpio_host_drive(config.intr, 1);
+        intr_low = false;
+    }
+}
+
+bool SimBno08x::lose(uint8_t chan) {
+    if (!chance(config.drop_permille)) return false;
+
+    // The host sees a gap in the sequence numbers
+    seq_out[chan]++;
+    counters.dropped++;
+    return true;
+}
+
+int64_t SimBno08x::jitter() {
+    if (config.jitter_us == 0) return 0;
+    return std::uniform_int_distribution<int64_t>{0, config.jitter_us}(rng);
+}
+
+bool SimBno08x::chance(uint32_t permille) {
+    if (permille == 0) return false;
+    return std::uniform_int_distribution<uint32_t>{0, 999}(rng) < permille;
+}
+
+esp_err_t SimBno08x::write_cb(void *ctx, const uint8_t *buf, size_t len) {
+    return reinterpret_cast<SimBno08x *>(ctx)->on_write({buf, len});
+}
+
+esp_err_t SimBno08x::read_cb(void *ctx, uint8_t *buf, size_t len) {
+    return reinterpret_cast<SimBno08x *>(ctx)->on_read({buf, len});
+}
+
+void SimBno08x::reset_cb(gpio_num_t pin, uint32_t level, void *ctx) {
+    reinterpret_cast<SimBno08x *>(ctx)->on_reset(level);
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <driver/gpio.h>
+#include <driver/i2c_master.h>
+#include <drivers/Bno08xProto.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace euler::sim {
+
+// Simulated BNO08x on the host I2C and GPIO shims, speaking enough SHTP and
+// SH-2 for the driver: it advertises itself and reports "reset complete" when
+// released from reset, answers Set Feature and FRS commands, and streams the
+// rotation vectors the driver enabled with base timestamps, batching and
+// continuations, like the device does. The orientation is a constant rotation
+// about a tilted axis, which can pause now and then, the stability classifier
+// and detector report the pauses. It can be put to sleep and turned back on
+// over the executable channel, sensors keep their configuration meanwhile.
+//
+// Faults can be injected to exercise the recovery paths: interrupt latency
+// jitter, a drifting sensor clock, dropped cargos, NACKed reads and corrupted
+// reports. They only affect sensor reports, commands always go through.
+class SimBno08x {
+public:
+    struct Config {
+        gpio_num_t intr;
+        gpio_num_t reset;
+        // Interrupt latency added to every cargo, uniformly distributed up to
+        // this many microseconds
+        uint32_t jitter_us = 0;
+        // Error of the sensor clock in parts per million, positive when it
+        // runs slow, as reported by Bno08x::clock_drift_ppm()
+        int32_t drift_ppm = 0;
+        // Probabilities of faults, in parts per thousand of cargos or reads
+        uint32_t drop_permille = 0;
+        uint32_t nack_permille = 0;
+        uint32_t corrupt_permille = 0;
+        // Speed of the simulated head, radians per second
+        float angular_speed = 1.0f;
+        // The head alternates between moving for this long and staying still
+        // for still_ms, it never stops if still_ms is zero
+        uint32_t moving_ms = 1000;
+        uint32_t still_ms = 0;
+        uint32_t seed = 1;
+    };
+
+    struct Stats {
+        uint64_t cargos;
+        uint64_t reports;
+        uint64_t dropped;
+        uint64_t nacked;
+        uint64_t corrupted;
+    };
+
+    explicit SimBno08x(const Config& config);
+    SimBno08x(const SimBno08x&) = delete;
+    SimBno08x(SimBno08x&&) = delete;
+    ~SimBno08x();
+
+    // Puts the device on the bus and wires it to its pins
+    bool attach(i2c_master_bus_handle_t bus);
+
+    Stats stats() const;
+
+private:
+    struct Feature {
+        uint8_t id;
+        // Zero when disabled
+        uint32_t interval_us = 0;
+        uint32_t batch_us = 0;
+        // Samples are taken at start + count periods of the sensor clock
+        int64_t start = 0;
+        uint64_t count = 0;
+        uint8_t seq = 0;
+    };
+
+    // Sample waiting in the batch, with its host and sensor times
+    struct Pending {
+        int64_t time;
+        int64_t sensor_time;
+        std::array<uint8_t, bno08x::ARVRStabilizedRotationVector::SIZE>
+            report;
+    };
+
+    struct Cargo {
+        // Earliest host time of the interrupt
+        int64_t due;
+        uint8_t chan;
+        std::vector<uint8_t> payload;
+        // Host time of the first sample if the cargo starts with a base
+        // timestamp, which is filled in when the interrupt fires
+        std::optional<int64_t> first_sample;
+    };
+
+    static constexpr uint8_t ADDRESS = 0x4a;
+    // Time from the reset line release to the advertisement
+    static constexpr int64_t BOOT_TIME_US = 20'000;
+    // Time from the "on" command to the sensors running again
+    static constexpr int64_t WAKE_TIME_US = 2'000;
+    // Time from a sample to its interrupt, before any jitter
+    static constexpr int64_t LATENCY_US = 300;
+    // Largest cargo the device sends, with its header
+    static constexpr size_t MAX_CARGO = 256;
+
+    void run();
+    void boot(int64_t now);
+    void sample(Feature& feature, int64_t time);
+    void send_stability(Feature& feature, uint8_t value, int64_t time);
+    void flush(int64_t now);
+    int64_t sample_time(const Feature& feature) const;
+    int64_t next_event(int64_t now) const;
+    Quat14 rotation(int64_t time) const;
+    bool moving(int64_t time) const;
+    // Time spent moving up to the given time
+    int64_t motion_time(int64_t time) const;
+    int64_t next_transition(int64_t time) const;
+
+    esp_err_t on_write(std::span<const uint8_t> buf);
+    esp_err_t on_read(std::span<uint8_t> buf);
+    void on_control(std::span<const uint8_t> cargo);
+    void on_executable(uint8_t command);
+    void on_reset(uint32_t level);
+
+    void send(uint8_t chan, std::vector<uint8_t> payload, int64_t due,
+              std::optional<int64_t> first_sample = std::nullopt);
+    void update_intr(bool edge);
+    // Drops a sensor cargo, as if it was lost
+    bool lose(uint8_t chan);
+    int64_t jitter();
+    bool chance(uint32_t permille);
+
+    static esp_err_t write_cb(void* ctx, const uint8_t* buf, size_t len);
+    static esp_err_t read_cb(void* ctx, uint8_t* buf, size_t len);
+    static void reset_cb(gpio_num_t pin, uint32_t level, void* ctx);
+
+    Config config;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool running = true;
+
+    bool in_reset = true;
+    // Host time at which the device finishes booting, zero if not booting
+    int64_t boot_at = 0;
+    bool asleep = false;
+
+    // Cargos waiting for their interrupt time, then to be read
+    std::deque<Cargo> outbox;
+    // Cargo being read out, how much of its payload was sent and whether the
+    // next transfer is a continuation
+    std::vector<uint8_t> current;
+    uint8_t current_chan = 0;
+    size_t current_off = 0;
+    bool current_started = false;
+    bool intr_low = false;
+
+    std::array<uint8_t, 6> seq_out{};
+
+    Feature arvr{.id = bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR};
+    Feature girv{.id = bno08x::report_id::GYRO_INTEGRATED_ROTATION_VECTOR};
+    Feature classifier{.id = bno08x::report_id::STABILITY_CLASSIFIER};
+    // Only reports changes, the last state it reported is kept
+    Feature detector{.id = bno08x::report_id::STABILITY_DETECTOR};
+    bool detected_moving = true;
+    std::vector<Pending> batch;
+
+    // FRS write in progress and the last record written, the device only
+    // remembers one
+    uint16_t frs_type = 0;
+    std::vector<uint32_t> frs_words;
+    uint16_t frs_record_type = 0;
+    std::vector<uint32_t> frs_record;
+
+    std::mt19937 rng;
+    Stats counters{};
+};
+
+}  // namespace euler::sim
@@ -0,0 +1,80 @@
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <utils/Tasklet.hpp>
+
+#include <cstdint>
+#include <cstdio>
+
+// Timed waits of the firmware tasks, see Tasklet::ticks_for(). Every check
+// prints what failed, the exit code is the number of failures.
+using namespace euler;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                  \
+    do {                                                             \
+        if (!(cond)) {                                               \
+            std::printf("%s:%d: check failed: %s\n", __FILE__,       \
+                        __LINE__, #cond);                            \
+            failures++;                                              \
+        }                                                            \
+    } while (0)
+
+// Default tick of the firmware, CONFIG_FREERTOS_HZ is 100
+constexpr int64_t TARGET_TICK_US = 10000;
+
+void test_rounding() {
+    // Connection intervals are shorter than a tick on the target
+    CHECK(Tasklet::ticks_for(7500, TARGET_TICK_US) == 1);
+    CHECK(Tasklet::ticks_for(15000, TARGET_TICK_US) == 2);
+    CHECK(Tasklet::ticks_for(10000, TARGET_TICK_US) == 1);
+    CHECK(Tasklet::ticks_for(10001, TARGET_TICK_US) == 2);
+    // An elapsed window still blocks for a tick
+    CHECK(Tasklet::ticks_for(0, TARGET_TICK_US) == 1);
+    CHECK(Tasklet::ticks_for(-5000, TARGET_TICK_US) == 1);
+}
+
+void test_no_early_wakeup() {
+    // A wait never ends before the time asked for, so a task waiting out a
+    // window wakes up once at most per tick of it
+    for (int64_t us = -TARGET_TICK_US; us <= 4 * TARGET_TICK_US; us += 250) {
+        TickType_t ticks = Tasklet::ticks_for(us, TARGET_TICK_US);
+        CHECK(ticks >= 1);
+        CHECK(int64_t(ticks) * TARGET_TICK_US >= us);
+        CHECK(int64_t(ticks - 1) * TARGET_TICK_US < us || ticks == 1);
+    }
+}
+
+void test_blocks() {
+    // Wait out a 7.5 ms connection interval like the tracker stream task
+    // does while it holds a packet, with nothing notifying it
+    constexpr int64_t WINDOW_US = 7500;
+    int64_t end = esp_timer_get_time() + WINDOW_US;
+    int wakeups = 0;
+
+    while (true) {
+        int64_t left = end - esp_timer_get_time();
+        if (left <= 0) break;
+
+        xTaskNotifyWait(0, 0, nullptr, Tasklet::ticks_for(left));
+        wakeups++;
+        if (wakeups > 100) break;
+    }
+
+    int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    CHECK(wakeups <= (WINDOW_US + tick_us - 1) / tick_us + 1);
+}
+
+}  // namespace
+
+int main() {
+    test_rounding();
+    test_no_early_wakeup();
+    test_blocks();
+
+    std::printf("%s, %d failures\n", failures == 0 ? "passed" : "FAILED",
+                failures);
+    return failures;
+}
@@ -1,7 +1,19 @@
 #include "Euler.hpp"
 
+#include <bench/FixedBench.hpp>
+#include <bench/ParseBench.hpp>
+#include <esp_attr.h>
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
+#include <power/Power.hpp>
+#include <sdkconfig.h>
+#include <utils/Boot.hpp>
+#include <utils/Heap.hpp>
+#include <utils/Log.hpp>
+#include <utils/Tasklet.hpp>
+#include <utils/Trace.hpp>
 
 #include "hwmapping.hpp"
 
@@ -9,7 +21,26 @@ static const char* TAG = "Euler";
 
 using namespace euler;
 
+// Survive deep sleep, they are only valid after waking up from one
+RTC_DATA_ATTR static Bno08x::Snapshot imu_snapshot;
+RTC_DATA_ATTR static bool imu_suspended = false;
+
 void Euler::init() {
+    boot::mark(boot::Phase::Init);
+
+    // Messages from the sample path are written out by a task of their own
+    log::init();
+
+    // Drivers take their PM locks and wake up sources from here on
+    if (!power::init()) {
+        ESP_LOGE(TAG, "Failed to set up power management");
+    }
+
+#if CONFIG_EULER_BENCHMARK
+    bench::run_fixed_point();
+    bench::run_parse();
+#endif
+
     gpio_install_isr_service(0);
 
     // Init I2C bus
@@ -19,8 +50,14 @@ void Euler::init() {
     i2c_config.scl_io_num = hwmapping::I2C_SCL;
     i2c_config.clk_source = I2C_CLK_SRC_DEFAULT;
     i2c_config.glitch_ignore_cnt = 7;
+    // Makes transfers asynchronous, see Bno08x::init()
+    i2c_config.trans_queue_depth = 4;
     i2c_new_master_bus(&i2c_config, &i2c_handle);
 
+    // Init IMU first, it boots while the rest of the board starts
+    init_imu();
+    boot::mark(boot::Phase::ImuQueued);
+
     // Init LEDs
     if (!usr_led1.init(hwmapping::USR_LED1)) {
         ESP_LOGE(TAG, "Failed to init user led 1");
@@ -30,22 +67,225 @@ void Euler::init() {
         ESP_LOGE(TAG, "Failed to init user led 2");
     }
 
-    // Init IMU
+    // Init USB lines. Keep awake is held through deep sleep, it would float
+    // otherwise and the USB bridge would never sleep, see docs/errata.md.
+    gpio_set_level(hwmapping::USB_KEEP_AWAKE, 0);
+    gpio_config_t usb_out_config = {};
+    usb_out_config.pin_bit_mask = 1ULL << hwmapping::USB_KEEP_AWAKE;
+    usb_out_config.mode = GPIO_MODE_OUTPUT;
+    usb_out_config.intr_type = GPIO_INTR_DISABLE;
+    gpio_config(&usb_out_config);
+    gpio_hold_dis(hwmapping::USB_KEEP_AWAKE);
+
+    gpio_config_t usb_in_config = {};
+    usb_in_config.pin_bit_mask =
+        (1ULL << hwmapping::USB_PWREN) | (1ULL << hwmapping::USB_BCD);
+    usb_in_config.mode = GPIO_MODE_INPUT;
+    // Open drain, driven low by the USB bridge
+    usb_in_config.pull_up_en = GPIO_PULLUP_ENABLE;
+    usb_in_config.intr_type = GPIO_INTR_DISABLE;
+    gpio_config(&usb_in_config);
+
+    // Init Bluetooth, samples are streamed as soon as a central subscribes
+    if (!ble.init(bno08x)) {
+        ESP_LOGE(TAG, "Failed to start bluetooth");
+    } else {
+        boot::mark(boot::Phase::Radio);
+    }
+
+    finish_imu();
+    boot::mark(boot::Phase::InitDone);
+
+    // Everything is set up, the heap shouldn't change from here on
+    heap::dump();
+    heap::seal();
+}
+
+void Euler::init_imu() {
+#if CONFIG_EULER_CAPTURE_REPLAY
+    // The recorded traffic stands in for the sensor, which is left alone. The
+    // capture already holds the start up, no commands are needed.
+    auto capture = bno08x::Recorder::map_partition();
+    if (!capture ||
+        !bno08x.init(
+            replay.emplace(*capture, CONFIG_EULER_CAPTURE_REPLAY_SPEED))) {
+        ESP_LOGE(TAG, "Failed to replay the bno08x capture");
+    }
+#else
+#if CONFIG_EULER_CAPTURE_UART || CONFIG_EULER_CAPTURE_FLASH
+    recorder.emplace();
+#if CONFIG_EULER_CAPTURE_UART
+    bool recording = recorder->init_uart(
+        uart_port_t(CONFIG_EULER_CAPTURE_UART_NUM),
+        gpio_num_t(CONFIG_EULER_CAPTURE_UART_TX),
+        CONFIG_EULER_CAPTURE_UART_BAUD_RATE);
+#else
+    bool recording = recorder->init_partition();
+#endif
+    if (!recording) {
+        ESP_LOGE(TAG, "Failed to start the bno08x capture");
+    } else {
+        bno08x.set_capture([this](const bno08x::CaptureRecord& record) {
+            recorder->record(record);
+        });
+    }
+#endif
+
     if (!bno08x.init(i2c_handle, hwmapping::BNO_IRQ, hwmapping::BNO_RESET,
-                      hwmapping::BNO_BOOTN)) {
+                     hwmapping::BNO_BOOTN)) {
         ESP_LOGE(TAG, "Failed to start bno08x");
-    } else {
-        // Perform actual IMU start up and boot
-        bno08x.start();
-        bno08x.enable_arvr_stabilized_rotation_vector(1000 * 1000);
+        return;
     }
+
+    // Nothing waits here, see finish_imu()
+    if (!resume_imu()) start_imu();
+#endif
+}
+
+bool Euler::resume_imu() {
+    // Whatever happens the snapshot is stale from now on
+    bool suspended = imu_suspended;
+    imu_suspended = false;
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP || !suspended) return false;
+
+    imu_boot = bno08x.resume(imu_snapshot);
+    imu_resuming = true;
+    return true;
+}
+
+void Euler::start_imu() {
+    // Perform actual IMU start up and boot. Commands are queued at once, the
+    // driver sends each one as soon as the previous one is answered.
+    imu_boot = bno08x.start();
+    imu_stream = bno08x.enable_arvr_stabilized_rotation_vector(
+        CONFIG_EULER_ROTATION_VECTOR_INTERVAL_US);
+
+#if CONFIG_EULER_ADAPTIVE_RATE
+    bno08x::AdaptiveRate::Config rate{
+        .still_interval = CONFIG_EULER_ADAPTIVE_RATE_STILL_INTERVAL_US,
+        .still_batch_interval = CONFIG_EULER_ADAPTIVE_RATE_STILL_BATCH_US,
+        .settle_time = CONFIG_EULER_ADAPTIVE_RATE_SETTLE_MS * 1000,
+        .classifier_interval =
+            CONFIG_EULER_ADAPTIVE_RATE_CLASSIFIER_INTERVAL_US};
+    imu_adaptive = bno08x.enable_adaptive_rate(rate);
+#endif
+}
+
+void Euler::finish_imu() {
+    // Nothing is queued when replaying a capture
+    if (!imu_boot.pending()) return;
+
+    if (imu_resuming) {
+        imu_resuming = false;
+        if (imu_boot.wait(portMAX_DELAY)) return;
+
+        ESP_LOGW(TAG, "Failed to resume bno08x, starting it over");
+        start_imu();
+    }
+
+    if (!imu_boot.wait(portMAX_DELAY)) {
+        ESP_LOGE(TAG, "Failed to boot bno08x");
+    }
+
+    if (!imu_stream.wait(portMAX_DELAY)) {
+        ESP_LOGE(TAG, "Failed to enable the rotation vector");
+    }
+
+#if CONFIG_EULER_ADAPTIVE_RATE
+    if (!imu_adaptive.wait(portMAX_DELAY)) {
+        ESP_LOGE(TAG, "Failed to enable the adaptive rate");
+    }
+#endif
 }
 
 void Euler::main() {
-    while (true) {
+    bool boot_logged = false;
+
+    for (uint32_t i = 0;; i++) {
+        // A short blink, the LED draws more than the rest of the board
         usr_led1.on();
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        vTaskDelay(pdMS_TO_TICKS(BLINK_ON_MS));
         usr_led1.off();
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        vTaskDelay(pdMS_TO_TICKS(BLINK_PERIOD_MS - BLINK_ON_MS));
+
+        if (i % TRACE_DUMP_PERIOD == TRACE_DUMP_PERIOD - 1) {
+            dump_trace();
+            power::dump();
+            Tasklet::dump();
+            heap::dump();
+        }
+
+        // Once, from the application start to the first orientation sample
+        if (!boot_logged && boot::time(boot::Phase::FirstSample)) {
+            boot::dump();
+            boot_logged = true;
+        }
+
+#if CONFIG_EULER_DEEP_SLEEP
+        if (idle()) deep_sleep();
+#endif
     }
+}
+
+bool Euler::idle() {
+    int64_t now = esp_timer_get_time();
+
+    // Plugged in or streaming, the tracker is in use
+    if (ble.connected() || gpio_get_level(hwmapping::USB_PWREN) == 0)
+        active_at = now;
+
+#if CONFIG_EULER_DEEP_SLEEP
+    return now - active_at >=
+           int64_t(CONFIG_EULER_DEEP_SLEEP_IDLE_S) * 1'000'000;
+#else
+    return false;
+#endif
+}
+
+void Euler::deep_sleep() {
+    // Sleeping is much cheaper for the IMU than booting, it picks up where it
+    // was on wake up, see resume_imu()
+    imu_suspended = bno08x.suspend().wait(portMAX_DELAY);
+    if (imu_suspended) {
+        imu_snapshot = bno08x.snapshot();
+    } else {
+        ESP_LOGW(TAG, "Failed to suspend bno08x, it will boot on wake up");
+    }
+
+    // Lets the USB bridge sleep
+    gpio_set_level(hwmapping::USB_KEEP_AWAKE, 1);
+    gpio_hold_en(hwmapping::USB_KEEP_AWAKE);
+
+    // Only LP IOs can wake the chip up, user button 2 isn't one
+    power::deep_sleep((1ULL << hwmapping::USR_BTN1) |
+                      (1ULL << hwmapping::USB_PWREN) |
+                      (1ULL << hwmapping::USB_BCD));
+
+    // Still awake, carry on as before
+    gpio_hold_dis(hwmapping::USB_KEEP_AWAKE);
+    gpio_set_level(hwmapping::USB_KEEP_AWAKE, 0);
+    if (imu_suspended) {
+        imu_suspended = false;
+        if (!bno08x.resume(imu_snapshot).wait(portMAX_DELAY)) {
+            start_imu();
+            finish_imu();
+        }
+    }
+
+    active_at = esp_timer_get_time();
+}
+
+void Euler::dump_trace() {
+    // Every dump covers the latencies since the previous one
+    for (size_t i = 0; i < trace::STAGE_COUNT; i++) {
+        trace::Stage stage = trace::Stage(i);
+        trace::Summary summary = trace::summary(stage);
+        ESP_LOGI(TAG,
+                 "Latency %-9s n: %6lu, p50: %6lu us, p99: %6lu us, "
+                 "max: %6lu us",
+                 trace::stage_name(stage), summary.count, summary.p50,
+                 summary.p99, summary.max);
+    }
+
+    trace::reset();
 }
\ No newline at end of file
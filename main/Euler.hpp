@@ -1,10 +1,15 @@
 #pragma once
 
+#include <ble/Peripheral.hpp>
 #include <drivers/Led.hpp>
 #include <drivers/Bno08x.hpp>
+#include <drivers/Bno08xRecorder.hpp>
+#include <drivers/Bno08xReplay.hpp>
 
 #include <driver/i2c_master.h>
 
+#include <optional>
+
 namespace euler {
 
 class Euler {
@@ -15,11 +20,43 @@ public:
     void main();
 
 private:
+    static constexpr uint32_t BLINK_PERIOD_MS = 2000;
+    static constexpr uint32_t BLINK_ON_MS = 50;
+    // Log the latency histograms and power stats every this many blinks
+    static constexpr uint32_t TRACE_DUMP_PERIOD = 5;
+
+    // The IMU set up is queued and left running, finish_imu() waits for it
+    // and falls back to a start if resuming failed
+    void init_imu();
+    void start_imu();
+    // Picks a suspended IMU up after a deep sleep, false if there was none
+    bool resume_imu();
+    void finish_imu();
+    void dump_trace();
+
+    // True once nothing used the tracker for EULER_DEEP_SLEEP_IDLE_S
+    bool idle();
+    // Suspends the IMU and deep sleeps, returns only if that failed
+    void deep_sleep();
+
     i2c_master_bus_handle_t i2c_handle = nullptr;
 
     Led usr_led1;
     Led usr_led2;
     Bno08x bno08x;
+    // Only used when capturing or replaying the IMU traffic
+    std::optional<bno08x::Recorder> recorder;
+    std::optional<bno08x::Replay> replay;
+    ble::Peripheral ble;
+
+    // IMU set up commands, they complete while the radio starts
+    Bno08x::Future imu_boot;
+    Bno08x::Future imu_stream;
+    Bno08x::Future imu_adaptive;
+    bool imu_resuming = false;
+
+    // Last time a central was connected or USB was plugged in
+    int64_t active_at = 0;
 };
 
 }
\ No newline at end of file
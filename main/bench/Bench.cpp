@@ -0,0 +1,22 @@
+#include "Bench.hpp"
+
+#include <esp_rom_sys.h>
+#include <sdkconfig.h>
+
+#include <cstdio>
+
+void euler::bench::report(const Result &result) {
+    double ns = double(result.cycles) * 1000.0 /
+                esp_rom_get_cpu_ticks_per_us() / result.iterations;
+
+    // Straight to stdout, log prefixes would get in the way of parsers
+    std::printf("{\"bench\":\"%s\",\"target\":\"%s\",\"iterations\":%u,"
+                "\"cycles_per_op\":%.1f,\"ns_per_op\":%.1f",
+                result.name, CONFIG_IDF_TARGET, unsigned(result.iterations),
+                double(result.cycles) / result.iterations, ns);
+    if (result.reports > 0)
+        std::printf(",\"ns_per_report\":%.1f", ns / result.reports);
+    if (result.bytes > 0)
+        std::printf(",\"bytes_per_s\":%.0f", result.bytes * 1e9 / ns);
+    std::printf("}\n");
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <esp_cpu.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace euler::bench {
+
+// Outcome of a benchmark. Results are printed as one JSON object per line,
+// the same on the device and on the host, so runs can be diffed between
+// commits.
+struct Result {
+    const char* name;
+    uint32_t iterations;
+    // Total cycles spent in the loop
+    uint32_t cycles;
+    // Bytes and reports handled per iteration, zero if not meaningful
+    size_t bytes;
+    size_t reports;
+};
+
+void report(const Result& result);
+
+// Cycles taken by a number of calls to a kernel. The loop must stay well
+// below 2^32 cycles, the counter wraps around.
+template <typename F>
+uint32_t measure(uint32_t iterations, F kernel) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < iterations; i++) kernel(i);
+    return esp_cpu_get_cycle_count() - start;
+}
+
+}  // namespace euler::bench
@@ -0,0 +1,73 @@
+#include "FixedBench.hpp"
+
+#include <utils/Fixed.hpp>
+
+#include <array>
+#include <cmath>
+
+#include "Bench.hpp"
+
+using namespace euler;
+using namespace euler::bench;
+
+static constexpr uint32_t ITERATIONS = 10'000;
+
+struct QuatF {
+    float x, y, z, w;
+};
+
+static QuatF multiply(QuatF a, QuatF b) {
+    return {a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+static QuatF normalize(QuatF q) {
+    float norm = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    return {q.x / norm, q.y / norm, q.z / norm, q.w / norm};
+}
+
+// What parsing used to do, a division per component
+static QuatF parse_float(const std::array<int16_t, 4> &raw) {
+    return {raw[0] / float(1 << 14), raw[1] / float(1 << 14),
+            raw[2] / float(1 << 14), raw[3] / float(1 << 14)};
+}
+
+// The inputs are read from a volatile to defeat constant folding and the
+// outputs written to one so they are not optimized away
+void euler::bench::run_fixed_point() {
+    volatile int16_t source[4] = {1000, -2000, 3000, 15000};
+    volatile int16_t fixed_sink = 0;
+    volatile float float_sink = 0;
+
+    auto raw = [&](uint32_t i) {
+        return std::array<int16_t, 4>{int16_t(source[0] + (i & 7)), source[1],
+                                      source[2], source[3]};
+    };
+
+    auto run = [](const char *name, auto kernel) {
+        report({.name = name,
+                .iterations = ITERATIONS,
+                .cycles = measure(ITERATIONS, kernel),
+                .bytes = 0,
+                .reports = 0});
+    };
+
+    run("fixed.parse_float",
+        [&](uint32_t i) { float_sink = parse_float(raw(i)).w; });
+    run("fixed.parse_fixed", [&](uint32_t i) {
+        std::array<int16_t, 4> r = raw(i);
+        fixed_sink = Quat14{r[0], r[1], r[2], r[3]}.w;
+    });
+
+    run("fixed.multiply_normalize_float", [&](uint32_t i) {
+        QuatF q = parse_float(raw(i));
+        float_sink = normalize(multiply(q, q)).w;
+    });
+    run("fixed.multiply_normalize_fixed", [&](uint32_t i) {
+        std::array<int16_t, 4> r = raw(i);
+        Quat14 q{r[0], r[1], r[2], r[3]};
+        fixed_sink = Quat14::normalize(Quat14::multiply(q, q)).w;
+    });
+}
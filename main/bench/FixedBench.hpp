@@ -0,0 +1,9 @@
+#pragma once
+
+namespace euler::bench {
+
+// Compare the fixed point quaternion kernels with the float path they
+// replace, prints a JSON line per benchmark
+void run_fixed_point();
+
+}  // namespace euler::bench
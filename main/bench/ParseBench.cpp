@@ -0,0 +1,161 @@
+#include "ParseBench.hpp"
+
+#include <drivers/Bno08x.hpp>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "Bench.hpp"
+
+using namespace euler;
+
+static constexpr uint32_t ITERATIONS = 10'000;
+// 1kHz reports batched every 16ms
+static constexpr size_t BATCH = 16;
+static constexpr int64_t BATCH_INTERVAL_US = 16'000;
+
+// A sensor cargo as the device sends it: header, base timestamp and a batch of
+// rotation vectors 1ms apart
+static std::vector<uint8_t> make_cargo() {
+    using Report = bno08x::ARVRStabilizedRotationVector;
+    size_t len = bno08x::Header::SIZE + bno08x::BaseTimestampReference::SIZE +
+                 BATCH * Report::SIZE;
+
+    std::vector<uint8_t> cargo(len);
+    bno08x::Header::write({.len = uint16_t(len),
+                           .chan = bno08x::channels::INPUT_SENSOR_REPORTS,
+                           .seq = 0},
+                          cargo);
+
+    std::span<uint8_t> reports{cargo.begin() + bno08x::Header::SIZE,
+                               cargo.end()};
+    reports[0] = bno08x::report_id::BASE_TIMESTAMP;
+    bno08x::write_u32(reports, 1, BATCH_INTERVAL_US / 100);
+
+    for (size_t i = 0; i < BATCH; i++) {
+        std::span<uint8_t> report =
+            reports.subspan(bno08x::BaseTimestampReference::SIZE +
+                                i * Report::SIZE,
+                            Report::SIZE);
+        uint16_t delay = i * 10;
+        report[0] = Report::ID;
+        report[1] = i;
+        report[2] = 3 | ((delay >> 8) << 2);
+        report[3] = delay & 0xff;
+        bno08x::write_u16(report, 4, 1000 + i);
+        bno08x::write_u16(report, 6, -2000);
+        bno08x::write_u16(report, 8, 3000);
+        bno08x::write_u16(report, 10, 15000);
+        bno08x::write_u16(report, 12, 410);
+    }
+
+    return cargo;
+}
+
+namespace euler::bench {
+
+// Drives the receive side of a Bno08x that was never initialized, there's no
+// device behind it
+class DriverBench {
+public:
+    static Result handle_generic(std::span<const uint8_t> cargo) {
+        auto driver = std::make_unique<Bno08x>();
+        std::copy(cargo.begin(), cargo.end(), driver->cargo_in.begin());
+        driver->header_in = bno08x::Header::read(cargo);
+
+        uint32_t cycles = measure(ITERATIONS, [&](uint32_t i) {
+            driver->cargo_in_time = int64_t(i) * BATCH_INTERVAL_US;
+            driver->cargo_in_stamp = trace::now();
+            driver->handle_generic();
+        });
+
+        return {.name = "bno08x.handle_generic",
+                .iterations = ITERATIONS,
+                .cycles = cycles,
+                .bytes = cargo.size(),
+                .reports = BATCH + 1};
+    }
+};
+
+}  // namespace euler::bench
+
+namespace {
+
+// Counts reports without doing anything with them, to time the walk alone
+struct NullHandler {
+    uint32_t count = 0;
+
+    void on_report(const bno08x::BaseTimestampReference &report) { count++; }
+    void on_report(const bno08x::ARVRStabilizedRotationVector &report) {
+        count++;
+    }
+};
+
+}  // namespace
+
+void euler::bench::run_parse() {
+    std::vector<uint8_t> cargo = make_cargo();
+    std::span<uint8_t> reports{cargo.begin() + bno08x::Header::SIZE,
+                               cargo.end()};
+    std::span<uint8_t> arvr =
+        reports.subspan(bno08x::BaseTimestampReference::SIZE,
+                        bno08x::ARVRStabilizedRotationVector::SIZE);
+
+    // Inputs change every iteration and outputs land in a volatile, so
+    // nothing gets hoisted out of the loops
+    volatile uint32_t sink = 0;
+
+    report({.name = "shtp.header_read",
+            .iterations = ITERATIONS,
+            .cycles = measure(ITERATIONS,
+                              [&](uint32_t i) {
+                                  cargo[3] = i;
+                                  bno08x::Header header =
+                                      bno08x::Header::read(cargo);
+                                  sink = header.len + header.seq;
+                              }),
+            .bytes = bno08x::Header::SIZE,
+            .reports = 0});
+
+    report({.name = "sh2.common_read",
+            .iterations = ITERATIONS,
+            .cycles = measure(ITERATIONS,
+                              [&](uint32_t i) {
+                                  arvr[3] = i;
+                                  auto common =
+                                      bno08x::SensorReportCommon::read(arvr);
+                                  sink = common.delay + uint32_t(common.status);
+                              }),
+            .bytes = bno08x::SensorReportCommon::SIZE,
+            .reports = 1});
+
+    report({.name = "sh2.arvr_read",
+            .iterations = ITERATIONS,
+            .cycles = measure(ITERATIONS,
+                              [&](uint32_t i) {
+                                  arvr[4] = i;
+                                  auto report =
+                                      bno08x::ARVRStabilizedRotationVector::
+                                          read(arvr);
+                                  sink = report.rotation.x + report.accuracy;
+                              }),
+            .bytes = bno08x::ARVRStabilizedRotationVector::SIZE,
+            .reports = 1});
+
+    using Dispatcher =
+        bno08x::ReportDispatcher<NullHandler, bno08x::BaseTimestampReference,
+                                 bno08x::ARVRStabilizedRotationVector>;
+    NullHandler handler;
+    report({.name = "sh2.dispatch",
+            .iterations = ITERATIONS,
+            .cycles = measure(ITERATIONS,
+                              [&](uint32_t i) {
+                                  reports[6] = i;
+                                  sink = Dispatcher::dispatch(handler, reports);
+                              }),
+            .bytes = reports.size(),
+            .reports = BATCH + 1});
+
+    report(DriverBench::handle_generic(cargo));
+}
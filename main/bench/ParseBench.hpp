@@ -0,0 +1,9 @@
+#pragma once
+
+namespace euler::bench {
+
+// Time the SHTP and SH-2 decoders and the full sensor cargo path of the
+// Bno08x driver over a batched cargo, prints a JSON line per benchmark
+void run_parse();
+
+}  // namespace euler::bench
@@ -0,0 +1,488 @@
+#include "HidService.hpp"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <host/ble_hs.h>
+#include <utils/Log.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+static const char *TAG = "HidService";
+
+using namespace euler;
+using namespace euler::ble;
+
+static constexpr uint16_t HID_SERVICE_UUID = 0x1812;
+static constexpr uint16_t HID_INFORMATION_UUID = 0x2a4a;
+static constexpr uint16_t REPORT_MAP_UUID = 0x2a4b;
+static constexpr uint16_t HID_CONTROL_POINT_UUID = 0x2a4c;
+static constexpr uint16_t REPORT_UUID = 0x2a4d;
+static constexpr uint16_t REPORT_REFERENCE_UUID = 0x2908;
+
+static constexpr uint16_t DEVICE_INFORMATION_UUID = 0x180a;
+static constexpr uint16_t MANUFACTURER_NAME_UUID = 0x2a29;
+static constexpr uint16_t PNP_ID_UUID = 0x2a50;
+
+static constexpr uint8_t REPORT_ID = 1;
+static constexpr uint8_t REPORT_TYPE_INPUT = 1;
+static constexpr uint8_t REPORT_TYPE_FEATURE = 3;
+
+static constexpr char DESCRIPTION[] = "#AndroidHeadTracker#1.0";
+static constexpr char MANUFACTURER[] = "Project Euler";
+
+// HID 1.11, no country, normally connectable
+static constexpr uint8_t HID_INFORMATION[] = {0x11, 0x01, 0x00, 0x02};
+// Bluetooth SIG assigned company id of Espressif, product 1, version 1.0
+static constexpr uint8_t PNP_ID[] = {0x01, 0xe5, 0x02, 0x01,
+                                     0x00, 0x00, 0x01};
+
+// clang-format off
+static constexpr uint8_t REPORT_MAP[] = {
+    0x05, 0x20,                     // Usage Page (Sensor)
+    0x09, 0xe1,                     // Usage (Sensor: Other: Custom)
+    0xa1, 0x00,                     // Collection (Physical)
+    0x85, REPORT_ID,                //   Report ID
+
+    // Feature report
+    0x0a, 0x08, 0x03,               //   Usage (Property: Sensor Description)
+    0x15, 0x00,                     //   Logical Minimum (0)
+    0x26, 0xff, 0x00,               //   Logical Maximum (255)
+    0x75, 0x08,                     //   Report Size (8)
+    0x95, 0x17,                     //   Report Count (23)
+    0xb1, 0x03,                     //   Feature (Const, Var, Abs)
+
+    0x0a, 0x02, 0x03,               //   Usage (Property: Persistent Unique ID)
+    0x95, 0x10,                     //   Report Count (16)
+    0xb1, 0x03,                     //   Feature (Const, Var, Abs)
+
+    0x0a, 0x16, 0x03,               //   Usage (Property: Reporting State)
+    0x25, 0x01,                     //   Logical Maximum (1)
+    0x75, 0x01,                     //   Report Size (1)
+    0x95, 0x01,                     //   Report Count (1)
+    0xa1, 0x02,                     //   Collection (Logical)
+    0x0a, 0x40, 0x08,               //     Usage (Reporting State: No Events)
+    0x0a, 0x41, 0x08,               //     Usage (Reporting State: All Events)
+    0xb1, 0x00,                     //     Feature (Data, Arr, Abs)
+    0xc0,                           //   End Collection
+
+    0x0a, 0x19, 0x03,               //   Usage (Property: Power State)
+    0xa1, 0x02,                     //   Collection (Logical)
+    0x0a, 0x55, 0x08,               //     Usage (Power State: D4 Power Off)
+    0x0a, 0x51, 0x08,               //     Usage (Power State: D0 Full Power)
+    0xb1, 0x00,                     //     Feature (Data, Arr, Abs)
+    0xc0,                           //   End Collection
+
+    0x0a, 0x0e, 0x03,               //   Usage (Property: Report Interval)
+    0x15, 0x0a,                     //   Logical Minimum (10)
+    0x25, 0x3f,                     //   Logical Maximum (63)
+    0x75, 0x06,                     //   Report Size (6)
+    0x66, 0x01, 0x10,               //   Unit (Seconds)
+    0x55, 0x0d,                     //   Unit Exponent (-3)
+    0xb1, 0x02,                     //   Feature (Data, Var, Abs)
+
+    // Input report
+    0x65, 0x00,                     //   Unit (None)
+    0x0a, 0x44, 0x05,               //   Usage (Custom Value 1)
+    0x16, 0x01, 0x80,               //   Logical Minimum (-32767)
+    0x26, 0xff, 0x7f,               //   Logical Maximum (32767)
+    0x37, 0x5f, 0x4f, 0x46, 0xed,   //   Physical Minimum (-314159265)
+    0x47, 0xa1, 0xb0, 0xb9, 0x12,   //   Physical Maximum (314159265)
+    0x55, 0x08,                     //   Unit Exponent (-8)
+    0x75, 0x10,                     //   Report Size (16)
+    0x95, 0x03,                     //   Report Count (3)
+    0x81, 0x02,                     //   Input (Data, Var, Abs)
+
+    0x0a, 0x45, 0x05,               //   Usage (Custom Value 2)
+    0x35, 0xe0,                     //   Physical Minimum (-32)
+    0x45, 0x20,                     //   Physical Maximum (32)
+    0x55, 0x00,                     //   Unit Exponent (0)
+    0x81, 0x02,                     //   Input (Data, Var, Abs)
+
+    0x0a, 0x46, 0x05,               //   Usage (Custom Value 3)
+    0x15, 0x00,                     //   Logical Minimum (0)
+    0x26, 0xff, 0x00,               //   Logical Maximum (255)
+    0x35, 0x00,                     //   Physical Minimum (0)
+    0x45, 0x00,                     //   Physical Maximum (0)
+    0x75, 0x08,                     //   Report Size (8)
+    0x95, 0x01,                     //   Report Count (1)
+    0x81, 0x02,                     //   Input (Data, Var, Abs)
+    0xc0,                           // End Collection
+};
+// clang-format on
+
+static const ble_uuid16_t HID_SERVICE = BLE_UUID16_INIT(HID_SERVICE_UUID);
+static const ble_uuid16_t HID_INFORMATION_CHR =
+    BLE_UUID16_INIT(HID_INFORMATION_UUID);
+static const ble_uuid16_t REPORT_MAP_CHR = BLE_UUID16_INIT(REPORT_MAP_UUID);
+static const ble_uuid16_t HID_CONTROL_POINT_CHR =
+    BLE_UUID16_INIT(HID_CONTROL_POINT_UUID);
+static const ble_uuid16_t REPORT_CHR = BLE_UUID16_INIT(REPORT_UUID);
+static const ble_uuid16_t REPORT_REFERENCE_DSC =
+    BLE_UUID16_INIT(REPORT_REFERENCE_UUID);
+static const ble_uuid16_t DEVICE_INFORMATION_SERVICE =
+    BLE_UUID16_INIT(DEVICE_INFORMATION_UUID);
+static const ble_uuid16_t MANUFACTURER_NAME_CHR =
+    BLE_UUID16_INIT(MANUFACTURER_NAME_UUID);
+static const ble_uuid16_t PNP_ID_CHR = BLE_UUID16_INIT(PNP_ID_UUID);
+
+static const uint8_t INPUT_REFERENCE[] = {REPORT_ID, REPORT_TYPE_INPUT};
+static const uint8_t FEATURE_REFERENCE[] = {REPORT_ID, REPORT_TYPE_FEATURE};
+
+static void write_i16(uint8_t *buf, int16_t value) {
+    buf[0] = uint16_t(value) & 0xff;
+    buf[1] = uint16_t(value) >> 8;
+}
+
+// Scale a value to the symmetric 16 bit logical range of the report map
+static int16_t to_logical(float value, float max) {
+    float scaled = std::round(value / max * 32767.0f);
+    return int16_t(std::clamp(scaled, -32767.0f, 32767.0f));
+}
+
+bool HidService::start(Bno08x &bno08x) {
+    input_descriptors[0] = {.uuid = &REPORT_REFERENCE_DSC.u,
+                            .att_flags = BLE_ATT_F_READ,
+                            .min_key_size = 0,
+                            .access_cb = access_reference,
+                            .arg = const_cast<uint8_t *>(INPUT_REFERENCE)};
+    input_descriptors[1] = {};
+    feature_descriptors[0] = {.uuid = &REPORT_REFERENCE_DSC.u,
+                              .att_flags = BLE_ATT_F_READ,
+                              .min_key_size = 0,
+                              .access_cb = access_reference,
+                              .arg = const_cast<uint8_t *>(FEATURE_REFERENCE)};
+    feature_descriptors[1] = {};
+
+    // HOGP wants everything but the information behind an encrypted link
+    hid_characteristics[0] = {.uuid = &HID_INFORMATION_CHR.u,
+                              .access_cb = access,
+                              .arg = this,
+                              .descriptors = nullptr,
+                              .flags = BLE_GATT_CHR_F_READ,
+                              .min_key_size = 0,
+                              .val_handle = &info_handle};
+    hid_characteristics[1] = {.uuid = &REPORT_MAP_CHR.u,
+                              .access_cb = access,
+                              .arg = this,
+                              .descriptors = nullptr,
+                              .flags = BLE_GATT_CHR_F_READ |
+                                       BLE_GATT_CHR_F_READ_ENC,
+                              .min_key_size = 0,
+                              .val_handle = &report_map_handle};
+    hid_characteristics[2] = {.uuid = &HID_CONTROL_POINT_CHR.u,
+                              .access_cb = access,
+                              .arg = this,
+                              .descriptors = nullptr,
+                              .flags = BLE_GATT_CHR_F_WRITE_NO_RSP,
+                              .min_key_size = 0,
+                              .val_handle = &control_point_handle};
+    hid_characteristics[3] = {.uuid = &REPORT_CHR.u,
+                              .access_cb = access,
+                              .arg = this,
+                              .descriptors = input_descriptors,
+                              .flags = BLE_GATT_CHR_F_READ |
+                                       BLE_GATT_CHR_F_READ_ENC |
+                                       BLE_GATT_CHR_F_NOTIFY,
+                              .min_key_size = 0,
+                              .val_handle = &input_handle};
+    hid_characteristics[4] = {.uuid = &REPORT_CHR.u,
+                              .access_cb = access,
+                              .arg = this,
+                              .descriptors = feature_descriptors,
+                              .flags = BLE_GATT_CHR_F_READ |
+                                       BLE_GATT_CHR_F_READ_ENC |
+                                       BLE_GATT_CHR_F_WRITE |
+                                       BLE_GATT_CHR_F_WRITE_ENC,
+                              .min_key_size = 0,
+                              .val_handle = &feature_handle};
+    hid_characteristics[5] = {};
+
+    info_characteristics[0] = {.uuid = &MANUFACTURER_NAME_CHR.u,
+                               .access_cb = access,
+                               .arg = this,
+                               .descriptors = nullptr,
+                               .flags = BLE_GATT_CHR_F_READ,
+                               .min_key_size = 0,
+                               .val_handle = &manufacturer_handle};
+    info_characteristics[1] = {.uuid = &PNP_ID_CHR.u,
+                               .access_cb = access,
+                               .arg = this,
+                               .descriptors = nullptr,
+                               .flags = BLE_GATT_CHR_F_READ,
+                               .min_key_size = 0,
+                               .val_handle = &pnp_id_handle};
+    info_characteristics[2] = {};
+
+    services[0] = {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+                   .uuid = &HID_SERVICE.u,
+                   .includes = nullptr,
+                   .characteristics = hid_characteristics};
+    services[1] = {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+                   .uuid = &DEVICE_INFORMATION_SERVICE.u,
+                   .includes = nullptr,
+                   .characteristics = info_characteristics};
+    services[2] = {};
+
+    this->bno08x = &bno08x;
+    if (!report.start("HidReport", Priority::Stream,
+                      [this]() { report_func(); })) {
+        ESP_LOGE(TAG, "Failed to start the report task");
+        return false;
+    }
+
+    return bno08x.add_listener(report.handle(), SAMPLE_NOTIFY);
+}
+
+void HidService::on_connect(uint16_t conn_handle) {
+    this->conn_handle = conn_handle;
+    subscribed = false;
+}
+
+void HidService::on_disconnect() {
+    // A new host starts from the defaults, the claim on the sensor is
+    // released until it asks for reports
+    subscribed = false;
+    reporting = false;
+    powered = false;
+    xTaskNotify(report.handle(), STATE_NOTIFY, eSetBits);
+}
+
+void HidService::on_subscribe(uint16_t attr_handle, bool notify) {
+    if (attr_handle != input_handle) return;
+
+    subscribed = notify;
+    xTaskNotify(report.handle(), STATE_NOTIFY, eSetBits);
+}
+
+void HidService::report_func() {
+    Bno08x::Samples::Reader reader{bno08x->samples()};
+    int64_t next_report = 0;
+
+#if CONFIG_EULER_PREDICTION
+    predictor.max_horizon = CONFIG_EULER_PREDICTION_MAX_HORIZON_US;
+#endif
+
+    bool applied = true;
+    while (true) {
+        // Keep retrying a claim the driver had no room for, the sensor may
+        // not produce samples to wake us up until it goes through
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, SAMPLE_NOTIFY | STATE_NOTIFY, &bits,
+                        applied ? portMAX_DELAY : RETRY_TIMEOUT);
+
+        if ((bits & STATE_NOTIFY) || !applied) applied = apply_state();
+
+        // Only the freshest sample is reported, the host picked the interval
+        Bno08x::Sample sample;
+        bool fresh = false;
+        while (reader.pop(sample)) {
+#if CONFIG_EULER_PREDICTION
+            predictor.update(sample);
+#endif
+            fresh = true;
+        }
+
+        if (!fresh || !subscribed || !reporting || !powered) continue;
+
+        int64_t now = esp_timer_get_time();
+        if (now < next_report) continue;
+
+        // Allow for some jitter of the sensor against our clock
+        next_report = now + interval_ms * 1000 * 3 / 4;
+
+        std::array<uint8_t, INPUT_SIZE> buf;
+#if CONFIG_EULER_PREDICTION
+        // Cover the age of the sample and the time it spends in the air
+        build_input(predictor.predict(
+                        now + CONFIG_EULER_PREDICTION_LINK_LATENCY_US),
+                    predictor.angular_velocity(), buf);
+#else
+        build_input(sample.rotation, sample.angular_velocity, buf);
+#endif
+
+        os_mbuf *om = ble_hs_mbuf_from_flat(buf.data(), buf.size());
+        if (om == nullptr) continue;
+
+        int rc = ble_gatts_notify_custom(conn_handle, input_handle, om);
+        if (rc != 0) {
+            EULER_LOGW(TAG, "Failed to notify the input report with err: %d",
+                       rc);
+            continue;
+        }
+
+        trace::record(trace::Stage::Send, sample.irq_stamp);
+    }
+}
+
+bool HidService::apply_state() {
+    uint32_t interval_us = 0;
+    if (reporting && powered) interval_us = interval_ms * 1000;
+    if (interval_us == applied_interval_us) return true;
+
+    // Other consumers keep the report going once released. The command is
+    // left to run in the background once queued, the driver records the
+    // claim when it runs.
+    Bno08x::Future future;
+    if (interval_us == 0) {
+        ESP_LOGI(TAG, "Releasing the rotation vector");
+        future = bno08x->release_arvr_stabilized_rotation_vector(
+            Bno08x::Consumer::Hid);
+    } else {
+        ESP_LOGI(TAG, "Claiming the rotation vector at %lu us", interval_us);
+        future = bno08x->enable_arvr_stabilized_rotation_vector(
+            interval_us, 0, Bno08x::Consumer::Hid);
+    }
+
+    if (!future.pending()) {
+        ESP_LOGW(TAG, "Failed to queue the rotation vector claim, retrying");
+        return false;
+    }
+
+    applied_interval_us = interval_us;
+    return true;
+}
+
+void HidService::build_input(const Quat14 &rotation,
+                             const std::array<int16_t, 3> &angular_velocity,
+                             std::array<uint8_t, INPUT_SIZE> &report) {
+    // The rotation vector is the rotation axis scaled by the angle, take the
+    // shortest rotation. The sensor is assumed to be mounted with its axes
+    // matching the head frame: x right, y forward, z up. This needs
+    // trigonometry, so it is the one place where samples become floats.
+    const Quat14 &q = rotation;
+    float sign = q.w < 0 ? -1.0f : 1.0f;
+    float x = fixed::to_float(q.x, Quat14::Q) * sign;
+    float y = fixed::to_float(q.y, Quat14::Q) * sign;
+    float z = fixed::to_float(q.z, Quat14::Q) * sign;
+    float w = fixed::to_float(q.w, Quat14::Q) * sign;
+
+    float sin_half = std::sqrt(x * x + y * y + z * z);
+    float angle = 2.0f * std::atan2(sin_half, w);
+    // The limit of angle / sin(angle / 2) is 2 for small angles
+    float scale = sin_half > 1e-6f ? angle / sin_half : 2.0f;
+
+    constexpr float PI = std::numbers::pi_v<float>;
+    write_i16(report.data(), to_logical(x * scale, PI));
+    write_i16(report.data() + 2, to_logical(y * scale, PI));
+    write_i16(report.data() + 4, to_logical(z * scale, PI));
+
+    // Q10 to the +-32 rad/s logical range is a plain integer rescale
+    for (size_t i = 0; i < 3; i++) {
+        int32_t value = angular_velocity[i];
+        write_i16(report.data() + 6 + 2 * i,
+                  fixed::saturate(fixed::div_round(value * 32767, 32 << 10)));
+    }
+
+    report[12] = reset_count.load();
+}
+
+void HidService::build_feature(std::array<uint8_t, FEATURE_SIZE> &report) {
+    std::copy_n(DESCRIPTION, DESCRIPTION_LEN, report.begin());
+
+    // Bluetooth trackers are identified by "BT" and their address in the
+    // last 6 bytes, most significant byte first as it is written, zeros in
+    // between. The identity address is the one we advertise with, public if
+    // the chip has one, static random otherwise.
+    uint8_t *id = report.data() + DESCRIPTION_LEN;
+    std::fill_n(id, UNIQUE_ID_LEN, 0);
+    id[0] = 'B';
+    id[1] = 'T';
+
+    uint8_t own_addr_type = 0;
+    std::array<uint8_t, 6> addr;
+    int rc = ble_hs_id_infer_auto(0, &own_addr_type);
+    if (rc == 0) {
+        bool is_public = own_addr_type == BLE_OWN_ADDR_PUBLIC ||
+                         own_addr_type == BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT;
+        rc = ble_hs_id_copy_addr(is_public ? BLE_ADDR_PUBLIC : BLE_ADDR_RANDOM,
+                                 addr.data(), nullptr);
+    }
+
+    // NimBLE keeps addresses least significant byte first
+    if (rc == 0) {
+        std::reverse_copy(addr.begin(), addr.end(),
+                          id + UNIQUE_ID_LEN - addr.size());
+    } else {
+        ESP_LOGW(TAG, "Failed to get our address with err: %d", rc);
+    }
+
+    report[FEATURE_SIZE - 1] = (reporting ? 1 : 0) | (powered ? 1 << 1 : 0) |
+                               (interval_ms << 2);
+}
+
+int HidService::on_access(uint16_t attr_handle, ble_gatt_access_ctxt *ctxt) {
+    auto append = [ctxt](const uint8_t *data, size_t len) {
+        return os_mbuf_append(ctxt->om, data, len) == 0
+                   ? 0
+                   : BLE_ATT_ERR_INSUFFICIENT_RES;
+    };
+
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        if (attr_handle == info_handle)
+            return append(HID_INFORMATION, sizeof(HID_INFORMATION));
+        if (attr_handle == report_map_handle)
+            return append(REPORT_MAP, sizeof(REPORT_MAP));
+        if (attr_handle == manufacturer_handle)
+            return append(reinterpret_cast<const uint8_t *>(MANUFACTURER),
+                          sizeof(MANUFACTURER) - 1);
+        if (attr_handle == pnp_id_handle)
+            return append(PNP_ID, sizeof(PNP_ID));
+
+        if (attr_handle == input_handle) {
+            // Reads are only used to poll, there is no sample to give
+            std::array<uint8_t, INPUT_SIZE> buf{};
+            return append(buf.data(), buf.size());
+        }
+
+        if (attr_handle == feature_handle) {
+            std::array<uint8_t, FEATURE_SIZE> buf;
+            build_feature(buf);
+            return append(buf.data(), buf.size());
+        }
+
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        // Suspend and exit suspend, the host turns reporting off anyway
+        if (attr_handle == control_point_handle) return 0;
+        if (attr_handle != feature_handle) return BLE_ATT_ERR_UNLIKELY;
+
+        std::array<uint8_t, FEATURE_SIZE> buf;
+        uint16_t len = 0;
+        if (OS_MBUF_PKTLEN(ctxt->om) != buf.size() ||
+            ble_hs_mbuf_to_flat(ctxt->om, buf.data(), buf.size(), &len) != 0)
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+
+        // Only the last byte is writable, the rest is constant
+        uint8_t state = buf[FEATURE_SIZE - 1];
+        reporting = state & 1;
+        powered = state & (1 << 1);
+        interval_ms = std::clamp<uint8_t>(state >> 2, MIN_INTERVAL_MS,
+                                          MAX_INTERVAL_MS);
+
+        ESP_LOGI(TAG, "Host set reporting: %d, power: %d, interval: %d ms",
+                 reporting.load(), powered.load(), interval_ms.load());
+        xTaskNotify(report.handle(), STATE_NOTIFY, eSetBits);
+        return 0;
+    }
+
+    return BLE_ATT_ERR_UNLIKELY;
+}
+
+int HidService::access(uint16_t conn_handle, uint16_t attr_handle,
+                       ble_gatt_access_ctxt *ctxt, void *arg) {
+    return reinterpret_cast<HidService *>(arg)->on_access(attr_handle, ctxt);
+}
+
+int HidService::access_reference(uint16_t conn_handle, uint16_t attr_handle,
+                                 ble_gatt_access_ctxt *ctxt, void *arg) {
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_DSC) return BLE_ATT_ERR_UNLIKELY;
+
+    return os_mbuf_append(ctxt->om, arg, 2) == 0
+               ? 0
+               : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <drivers/Bno08x.hpp>
+#include <host/ble_gatt.h>
+#include <pose/Predictor.hpp>
+#include <sdkconfig.h>
+#include <utils/Tasklet.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace euler::ble {
+
+// HID over GATT head tracker, following the Android head tracker HID
+// protocol (#AndroidHeadTracker#1.0), so phones can use it for spatial audio
+// without any companion app. Comes with the Device Information service that
+// HOGP requires.
+//
+// The host drives the sensor: it turns reporting and power on and off and
+// picks the report interval through the feature report, which we translate
+// to a claim on the rotation vector of the Bno08x. The device never runs
+// slower than the other consumers asked for.
+class HidService {
+public:
+    HidService() {}
+    HidService(const HidService&) = delete;
+    HidService(HidService&&) = delete;
+
+    bool start(Bno08x& bno08x);
+
+    const ble_gatt_svc_def* definitions() const { return services; }
+
+    // Connection events, forwarded by the Peripheral from the NimBLE host task
+    void on_connect(uint16_t conn_handle);
+    void on_disconnect();
+    void on_subscribe(uint16_t attr_handle, bool notify);
+
+    // Tell the host our reference frame changed, e.g. after a recenter
+    void on_frame_reset() { reset_count.fetch_add(1); }
+
+private:
+    // Report interval bounds in milliseconds, the field is 6 bits wide
+    static constexpr uint8_t MIN_INTERVAL_MS = 10;
+    static constexpr uint8_t MAX_INTERVAL_MS = 63;
+
+    static constexpr size_t DESCRIPTION_LEN = 23;
+    static constexpr size_t UNIQUE_ID_LEN = 16;
+    static constexpr size_t FEATURE_SIZE = DESCRIPTION_LEN + UNIQUE_ID_LEN + 1;
+    static constexpr size_t INPUT_SIZE = 13;
+
+    // Task notification bits of the report task
+    static constexpr uint32_t SAMPLE_NOTIFY = 1 << 0;
+    static constexpr uint32_t STATE_NOTIFY = 1 << 1;
+    // Wait before claiming the sensor again when the driver queue was full
+    static constexpr TickType_t RETRY_TIMEOUT = pdMS_TO_TICKS(100);
+
+    void report_func();
+    bool apply_state();
+    void build_input(const Quat14& rotation,
+                     const std::array<int16_t, 3>& angular_velocity,
+                     std::array<uint8_t, INPUT_SIZE>& report);
+    void build_feature(std::array<uint8_t, FEATURE_SIZE>& report);
+
+    int on_access(uint16_t attr_handle, ble_gatt_access_ctxt* ctxt);
+
+    static int access(uint16_t conn_handle, uint16_t attr_handle,
+                      ble_gatt_access_ctxt* ctxt, void* arg);
+    static int access_reference(uint16_t conn_handle, uint16_t attr_handle,
+                                ble_gatt_access_ctxt* ctxt, void* arg);
+
+    Bno08x* bno08x = nullptr;
+    StaticTasklet<4 * 1024> report;
+#if CONFIG_EULER_PREDICTION
+    Predictor predictor;
+#endif
+
+    // Connection state, written by the host task
+    std::atomic<uint16_t> conn_handle{0};
+    std::atomic<bool> subscribed{false};
+
+    // Host controlled state, from the feature report
+    std::atomic<bool> reporting{false};
+    std::atomic<bool> powered{false};
+    std::atomic<uint8_t> interval_ms{MAX_INTERVAL_MS};
+    // Interval the sensor was last claimed with, zero when released. Only
+    // updated once the driver accepted the command.
+    uint32_t applied_interval_us = 0;
+
+    std::atomic<uint8_t> reset_count{0};
+
+    uint16_t input_handle = 0;
+    uint16_t feature_handle = 0;
+    uint16_t info_handle = 0;
+    uint16_t report_map_handle = 0;
+    uint16_t control_point_handle = 0;
+    uint16_t pnp_id_handle = 0;
+    uint16_t manufacturer_handle = 0;
+
+    ble_gatt_dsc_def input_descriptors[2];
+    ble_gatt_dsc_def feature_descriptors[2];
+    ble_gatt_chr_def hid_characteristics[6];
+    ble_gatt_chr_def info_characteristics[3];
+    ble_gatt_svc_def services[3];
+};
+
+}  // namespace euler::ble
@@ -0,0 +1,261 @@
+#include "Peripheral.hpp"
+
+#include <esp_log.h>
+#include <nvs_flash.h>
+#include <host/ble_hs.h>
+#include <host/util/util.h>
+#include <nimble/nimble_port.h>
+#include <nimble/nimble_port_freertos.h>
+#include <services/gap/ble_svc_gap.h>
+#include <services/gatt/ble_svc_gatt.h>
+
+#include <cstring>
+
+static const char *TAG = "Peripheral";
+
+// Not exposed by any NimBLE header
+extern "C" void ble_store_config_init(void);
+
+using namespace euler;
+using namespace euler::ble;
+
+Peripheral *Peripheral::instance = nullptr;
+
+bool Peripheral::init(Bno08x &bno08x) {
+    if (is_init || instance != nullptr) return false;
+
+    // Bonds are persisted in NVS
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES ||
+        err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init NVS with err: %d", err);
+        return false;
+    }
+
+    err = nimble_port_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init NimBLE with err: %d", err);
+        return false;
+    }
+
+    instance = this;
+    ble_hs_cfg.sync_cb = on_sync;
+    ble_hs_cfg.reset_cb = on_reset;
+
+    // HOGP hosts require bonding, we have no display nor keyboard
+    ble_hs_cfg.sm_io_cap = BLE_SM_IO_CAP_NO_IO;
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist =
+        BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist =
+        BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_store_config_init();
+
+    ble_svc_gap_init();
+    ble_svc_gatt_init();
+
+    if (!tracker.start(bno08x)) {
+        ESP_LOGE(TAG, "Failed to start the tracker service");
+        return false;
+    }
+
+    if (!hid.start(bno08x)) {
+        ESP_LOGE(TAG, "Failed to start the HID service");
+        return false;
+    }
+
+    for (const ble_gatt_svc_def *defs :
+         {tracker.definitions(), hid.definitions()}) {
+        int rc = ble_gatts_count_cfg(defs);
+        if (rc == 0) rc = ble_gatts_add_svcs(defs);
+        if (rc != 0) {
+            ESP_LOGE(TAG, "Failed to register GATT services with err: %d",
+                     rc);
+            return false;
+        }
+    }
+
+    ble_svc_gap_device_name_set(DEVICE_NAME);
+    ble_svc_gap_device_appearance_set(APPEARANCE);
+
+    is_init = true;
+    nimble_port_freertos_init(host_task);
+    return true;
+}
+
+void Peripheral::advertise() {
+    ble_hs_adv_fields fields = {};
+    fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
+    fields.name = reinterpret_cast<const uint8_t *>(DEVICE_NAME);
+    fields.name_len = strlen(DEVICE_NAME);
+    fields.name_is_complete = 1;
+    fields.appearance = APPEARANCE;
+    fields.appearance_is_present = 1;
+
+    // Hosts look for HID devices by service
+    static const ble_uuid16_t HID_SERVICE = BLE_UUID16_INIT(0x1812);
+    fields.uuids16 = &HID_SERVICE;
+    fields.num_uuids16 = 1;
+    fields.uuids16_is_complete = 0;
+
+    int rc = ble_gap_adv_set_fields(&fields);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Failed to set advertising data with err: %d", rc);
+        return;
+    }
+
+    ble_gap_adv_params params = {};
+    params.conn_mode = BLE_GAP_CONN_MODE_UND;
+    params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+
+    rc = ble_gap_adv_start(own_addr_type, nullptr, BLE_HS_FOREVER, &params,
+                           gap_event, this);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Failed to start advertising with err: %d", rc);
+    }
+}
+
+void Peripheral::tune_link(uint16_t conn_handle) {
+    // Everything here is a request, the central has the last word and we
+    // get told through GAP events. Failures are not fatal.
+    ble_gap_upd_params params = {.itvl_min = MIN_INTERVAL,
+                                 .itvl_max = MAX_INTERVAL,
+                                 .latency = 0,
+                                 .supervision_timeout = SUPERVISION_TIMEOUT,
+                                 .min_ce_len = 0,
+                                 .max_ce_len = 0};
+    int rc = ble_gap_update_params(conn_handle, &params);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to request connection params with err: %d", rc);
+    }
+
+    rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                     BLE_GAP_LE_PHY_2M_MASK,
+                                     BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to request the 2M PHY with err: %d", rc);
+    }
+
+    rc = ble_gap_set_data_len(conn_handle, MAX_TX_OCTETS, MAX_TX_TIME);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to request data length extension with err: %d",
+                 rc);
+    }
+
+    // Up to the preferred MTU from sdkconfig
+    rc = ble_gattc_exchange_mtu(conn_handle, nullptr, nullptr);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to exchange the MTU with err: %d", rc);
+    }
+}
+
+int Peripheral::on_gap_event(ble_gap_event *event) {
+    switch (event->type) {
+        case BLE_GAP_EVENT_CONNECT: {
+            if (event->connect.status != 0) {
+                advertise();
+                break;
+            }
+
+            ble_gap_conn_desc desc;
+            ble_gap_conn_find(event->connect.conn_handle, &desc);
+            ESP_LOGI(TAG, "Connected, interval: %d", desc.conn_itvl);
+            is_connected.store(true);
+
+            tracker.on_connect(event->connect.conn_handle, desc.conn_itvl);
+            hid.on_connect(event->connect.conn_handle);
+            tune_link(event->connect.conn_handle);
+
+            // Bonded hosts expect us to restore encryption right away
+            ble_gap_security_initiate(event->connect.conn_handle);
+            break;
+        }
+
+        case BLE_GAP_EVENT_DISCONNECT:
+            ESP_LOGI(TAG, "Disconnected, reason: %d",
+                     event->disconnect.reason);
+            is_connected.store(false);
+            tracker.on_disconnect();
+            hid.on_disconnect();
+            advertise();
+            break;
+
+        case BLE_GAP_EVENT_CONN_UPDATE: {
+            ble_gap_conn_desc desc;
+            if (ble_gap_conn_find(event->conn_update.conn_handle, &desc) ==
+                0) {
+                ESP_LOGI(TAG, "Connection interval: %d", desc.conn_itvl);
+                tracker.on_interval(desc.conn_itvl);
+            }
+            break;
+        }
+
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            ESP_LOGI(TAG, "PHY tx: %d, rx: %d", event->phy_updated.tx_phy,
+                     event->phy_updated.rx_phy);
+            break;
+
+        case BLE_GAP_EVENT_MTU:
+            ESP_LOGI(TAG, "MTU: %d", event->mtu.value);
+            tracker.on_mtu(event->mtu.value);
+            break;
+
+        case BLE_GAP_EVENT_SUBSCRIBE:
+            tracker.on_subscribe(event->subscribe.attr_handle,
+                                 event->subscribe.cur_notify);
+            hid.on_subscribe(event->subscribe.attr_handle,
+                             event->subscribe.cur_notify);
+            break;
+
+        case BLE_GAP_EVENT_ENC_CHANGE:
+            ESP_LOGI(TAG, "Encryption change, status: %d",
+                     event->enc_change.status);
+            break;
+
+        case BLE_GAP_EVENT_REPEAT_PAIRING: {
+            // The host lost our bond, forget its one and pair again
+            ble_gap_conn_desc desc;
+            if (ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc) ==
+                0)
+                ble_store_util_delete_peer(&desc.peer_id_addr);
+            return BLE_GAP_REPEAT_PAIRING_RETRY;
+        }
+
+        case BLE_GAP_EVENT_ADV_COMPLETE:
+            advertise();
+            break;
+    }
+
+    return 0;
+}
+
+void Peripheral::on_sync() {
+    int rc = ble_hs_util_ensure_addr(0);
+    if (rc == 0) rc = ble_hs_id_infer_auto(0, &instance->own_addr_type);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Failed to find an address with err: %d", rc);
+        return;
+    }
+
+    instance->advertise();
+}
+
+void Peripheral::on_reset(int reason) {
+    ESP_LOGW(TAG, "NimBLE host reset, reason: %d", reason);
+}
+
+int Peripheral::gap_event(ble_gap_event *event, void *that) {
+    return reinterpret_cast<Peripheral *>(that)->on_gap_event(event);
+}
+
+void Peripheral::host_task(void *param) {
+    // Returns only when nimble_port_stop() is called
+    nimble_port_run();
+    nimble_port_freertos_deinit();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <drivers/Bno08x.hpp>
+#include <host/ble_gap.h>
+
+#include <atomic>
+
+#include "HidService.hpp"
+#include "TrackerService.hpp"
+
+namespace euler::ble {
+
+// Owns the NimBLE host: advertises, accepts a single central, bonds with it
+// and tunes the link for low latency streaming once connected
+class Peripheral {
+public:
+    Peripheral() {}
+    Peripheral(const Peripheral&) = delete;
+    Peripheral(Peripheral&&) = delete;
+
+    bool init(Bno08x& bno08x);
+
+    // Whether a central is connected, can be called from any task
+    bool connected() const { return is_connected.load(); }
+
+private:
+    void advertise();
+    void tune_link(uint16_t conn_handle);
+
+    int on_gap_event(ble_gap_event* event);
+
+    static void on_sync();
+    static void on_reset(int reason);
+    static int gap_event(ble_gap_event* event, void* that);
+    static void host_task(void* param);
+
+    static constexpr const char* DEVICE_NAME = "Euler";
+    // Generic HID, so hosts show us as an input device
+    static constexpr uint16_t APPEARANCE = 0x03c0;
+
+    // Connection interval bounds, in 1.25ms units
+    static constexpr uint16_t MIN_INTERVAL = 6;
+    static constexpr uint16_t MAX_INTERVAL = 12;
+    // Supervision timeout, in 10ms units
+    static constexpr uint16_t SUPERVISION_TIMEOUT = 200;
+    // Largest link layer payload and the time it takes on the 1M PHY
+    static constexpr uint16_t MAX_TX_OCTETS = 251;
+    static constexpr uint16_t MAX_TX_TIME = 2120;
+
+    // NimBLE callbacks without a user argument need to find us
+    static Peripheral* instance;
+
+    bool is_init = false;
+    uint8_t own_addr_type = 0;
+    std::atomic<bool> is_connected{false};
+
+    TrackerService tracker;
+    HidService hid;
+};
+
+}  // namespace euler::ble
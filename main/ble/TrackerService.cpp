@@ -0,0 +1,194 @@
+#include "TrackerService.hpp"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <host/ble_hs.h>
+#include <utils/Log.hpp>
+
+#include <algorithm>
+
+static const char *TAG = "TrackerService";
+
+using namespace euler;
+using namespace euler::ble;
+
+// 7a1e0001-4f0b-4c7e-9b52-3d7c2a6e1f00
+static const ble_uuid128_t SERVICE_UUID =
+    BLE_UUID128_INIT(0x00, 0x1f, 0x6e, 0x2a, 0x7c, 0x3d, 0x52, 0x9b, 0x7e,
+                     0x4c, 0x0b, 0x4f, 0x01, 0x00, 0x1e, 0x7a);
+// 7a1e0002-4f0b-4c7e-9b52-3d7c2a6e1f00
+static const ble_uuid128_t SAMPLES_UUID =
+    BLE_UUID128_INIT(0x00, 0x1f, 0x6e, 0x2a, 0x7c, 0x3d, 0x52, 0x9b, 0x7e,
+                     0x4c, 0x0b, 0x4f, 0x02, 0x00, 0x1e, 0x7a);
+
+static void write_u16(uint8_t *buf, uint16_t value) {
+    buf[0] = value & 0xff;
+    buf[1] = value >> 8;
+}
+
+bool TrackerService::start(Bno08x &bno08x) {
+    characteristics[0] = {.uuid = &SAMPLES_UUID.u,
+                          .access_cb = access,
+                          .arg = this,
+                          .descriptors = nullptr,
+                          .flags = BLE_GATT_CHR_F_NOTIFY,
+                          .min_key_size = 0,
+                          .val_handle = &value_handle};
+    characteristics[1] = {};
+
+    services[0] = {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+                   .uuid = &SERVICE_UUID.u,
+                   .includes = nullptr,
+                   .characteristics = characteristics};
+    services[1] = {};
+
+    samples = &bno08x.samples();
+    if (!stream.start("TrackerStream", Priority::Stream,
+                      [this]() { stream_func(); })) {
+        ESP_LOGE(TAG, "Failed to start the stream task");
+        return false;
+    }
+
+    return bno08x.add_listener(stream.handle(), SAMPLE_NOTIFY);
+}
+
+void TrackerService::on_connect(uint16_t conn_handle, uint16_t interval) {
+    this->conn_handle = conn_handle;
+    this->interval = interval;
+    payload_size = 20;
+    subscribed = false;
+    xTaskNotify(stream.handle(), STATE_NOTIFY, eSetBits);
+}
+
+void TrackerService::on_disconnect() {
+    subscribed = false;
+    xTaskNotify(stream.handle(), STATE_NOTIFY, eSetBits);
+}
+
+void TrackerService::on_interval(uint16_t interval) {
+    this->interval = interval;
+}
+
+void TrackerService::on_mtu(uint16_t mtu) {
+    // Three bytes of ATT header per notification
+    payload_size = std::min<size_t>(mtu - 3, MAX_PAYLOAD);
+}
+
+void TrackerService::on_subscribe(uint16_t attr_handle, bool notify) {
+    if (attr_handle != value_handle) return;
+
+    subscribed = notify;
+    xTaskNotify(stream.handle(), STATE_NOTIFY, eSetBits);
+}
+
+void TrackerService::stream_func() {
+    Bno08x::Samples::Reader reader{*samples};
+
+    while (true) {
+        // Sleep until new samples come in, or until the next interval if we
+        // ran out of notifications for this one
+        TickType_t timeout = portMAX_DELAY;
+        if (packet_count > 0 || holding) {
+            int64_t interval_us = interval * 1250;
+            int64_t left = window_start + interval_us - esp_timer_get_time();
+            timeout = Tasklet::ticks_for(left);
+        }
+
+        xTaskNotifyWait(0, SAMPLE_NOTIFY | STATE_NOTIFY, nullptr, timeout);
+
+        if (!subscribed) {
+            // Nobody is listening, skip whatever was published meanwhile
+            reader.latest(held);
+            holding = false;
+            packet_count = 0;
+            continue;
+        }
+
+        while (true) {
+            // Fill the packet with whatever is pending, then send it if the
+            // current interval still allows it
+            while (true) {
+                if (!holding) {
+                    if (!reader.pop(held)) break;
+                    held_sequence = reader.position() - 1;
+                    holding = true;
+                }
+
+                // Samples in a packet are contiguous, lost ones show up as a
+                // gap between two packets
+                if (packet_count > 0 &&
+                    held_sequence != uint16_t(sequence + packet_count))
+                    break;
+
+                if (!pack(held)) break;
+                holding = false;
+            }
+
+            if (packet_count == 0 || !flush()) break;
+        }
+    }
+}
+
+bool TrackerService::pack(const Bno08x::Sample &sample) {
+    if (packet_count == 0) {
+        // Every packet is a stream of its own, starting with a keyframe
+        sequence = held_sequence;
+        encoder = codec::Encoder{std::span<uint8_t>(
+            packet.data() + HEADER_SIZE, payload_size - HEADER_SIZE)};
+    }
+
+    if (packet_count == MAX_SAMPLES ||
+        !encoder.add(uint32_t(sample.timestamp), sample.rotation))
+        return false;
+
+    packet[0] = packet_count + 1;
+    packet[1] = uint8_t(sample.status);
+    write_u16(packet.data() + 2, sequence);
+    // Angular velocity is already in the wire format
+    write_u16(packet.data() + 4, sample.angular_velocity[0]);
+    write_u16(packet.data() + 6, sample.angular_velocity[1]);
+    write_u16(packet.data() + 8, sample.angular_velocity[2]);
+
+    packet_stamps[packet_count++] = sample.irq_stamp;
+    return true;
+}
+
+bool TrackerService::flush() {
+    // Start a new window once the connection interval has elapsed
+    int64_t now = esp_timer_get_time();
+    if (now - window_start >= interval * 1250) {
+        window_start = now;
+        window_sent = 0;
+    }
+
+    if (window_sent >= NOTIFY_PER_INTERVAL) return false;
+
+    size_t len = HEADER_SIZE + encoder.bytes();
+    os_mbuf *om = ble_hs_mbuf_from_flat(packet.data(), len);
+    if (om == nullptr) {
+        // The stack is out of buffers, the link is behind: keep packing
+        // samples and retry on the next interval
+        window_sent = NOTIFY_PER_INTERVAL;
+        return false;
+    }
+
+    int rc = ble_gatts_notify_custom(conn_handle, value_handle, om);
+    if (rc != 0) {
+        EULER_LOGW(TAG, "Failed to notify samples with err: %d", rc);
+        window_sent = NOTIFY_PER_INTERVAL;
+        return false;
+    }
+
+    for (size_t i = 0; i < packet_count; i++)
+        trace::record(trace::Stage::Send, packet_stamps[i]);
+
+    packet_count = 0;
+    window_sent++;
+    return true;
+}
+
+int TrackerService::access(uint16_t conn_handle, uint16_t attr_handle,
+                           ble_gatt_access_ctxt *ctxt, void *arg) {
+    // The characteristic can only be subscribed to
+    return BLE_ATT_ERR_READ_NOT_PERMITTED;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <codec/QuatCodec.hpp>
+#include <drivers/Bno08x.hpp>
+#include <host/ble_gatt.h>
+#include <utils/Tasklet.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace euler::ble {
+
+// Streams orientation samples as notifications of a single characteristic.
+//
+// Every notification carries as many samples as were pending when it was
+// sent, all little endian:
+//   uint8_t  count      number of samples that follow
+//   uint8_t  status     sensor accuracy status of the last sample, 0-3
+//   uint16_t sequence   index of the first sample, gaps mean lost samples
+//   int16_t  angular_x, angular_y, angular_z
+//                       angular velocity of the last sample in rad/s, Q10
+//   count samples encoded by codec::Encoder, timestamps in microseconds
+//
+// Each notification starts a new codec stream, so it decodes on its own and a
+// lost one costs only its samples. With the delta frames a full notification
+// carries about four times as many samples as raw Q14 ones would.
+//
+// Notifications are paced by the connection interval: at most
+// NOTIFY_PER_INTERVAL of them are queued per interval, samples arriving in
+// between are packed together. At high sample rates this keeps the number of
+// packets per connection event bounded, at low rates every sample is sent as
+// soon as it is published.
+class TrackerService {
+public:
+    TrackerService() {}
+    TrackerService(const TrackerService&) = delete;
+    TrackerService(TrackerService&&) = delete;
+
+    bool start(Bno08x& bno08x);
+
+    const ble_gatt_svc_def* definitions() const { return services; }
+
+    // Connection events, forwarded by the Peripheral from the NimBLE host task
+    void on_connect(uint16_t conn_handle, uint16_t interval);
+    void on_disconnect();
+    void on_interval(uint16_t interval);
+    void on_mtu(uint16_t mtu);
+    void on_subscribe(uint16_t attr_handle, bool notify);
+
+private:
+    static constexpr size_t HEADER_SIZE = 10;
+    // Largest ATT payload with data length extension
+    static constexpr size_t MAX_PAYLOAD = 244;
+    static constexpr size_t MAX_SAMPLES =
+        (MAX_PAYLOAD - HEADER_SIZE) * 8 / codec::DELTA_FRAME_BITS;
+    static constexpr uint32_t NOTIFY_PER_INTERVAL = 2;
+
+    // Task notification bits of the stream task
+    static constexpr uint32_t SAMPLE_NOTIFY = 1 << 0;
+    static constexpr uint32_t STATE_NOTIFY = 1 << 1;
+
+    void stream_func();
+    bool flush();
+    bool pack(const Bno08x::Sample& sample);
+
+    static int access(uint16_t conn_handle, uint16_t attr_handle,
+                      ble_gatt_access_ctxt* ctxt, void* arg);
+
+    const Bno08x::Samples* samples = nullptr;
+    StaticTasklet<4 * 1024> stream;
+
+    // Connection state, written by the host task
+    std::atomic<uint16_t> conn_handle{0};
+    std::atomic<bool> subscribed{false};
+    // Connection interval in 1.25ms units
+    std::atomic<uint16_t> interval{0};
+    std::atomic<uint16_t> payload_size{20};
+
+    // Packet being filled, owned by the stream task
+    std::array<uint8_t, MAX_PAYLOAD> packet;
+    std::array<uint32_t, MAX_SAMPLES> packet_stamps;
+    codec::Encoder encoder{{}};
+    size_t packet_count = 0;
+    uint16_t sequence = 0;
+    // Sample popped from the ring that did not fit in the packet
+    Bno08x::Sample held;
+    uint16_t held_sequence = 0;
+    bool holding = false;
+    int64_t window_start = 0;
+    uint32_t window_sent = 0;
+
+    uint16_t value_handle = 0;
+    ble_gatt_chr_def characteristics[2];
+    ble_gatt_svc_def services[2];
+};
+
+}  // namespace euler::ble
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <utils/Fixed.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <span>
+
+// Compact encoding of timestamped orientation streams. This header has no
+// platform dependencies, the same code decodes the stream on the host.
+//
+// Quaternions are packed with the smallest three method: the largest
+// component is dropped, the quaternion negated so that it is positive, and the
+// other three, which lie within +-1/sqrt(2), are quantized to 12 bits. The
+// decoder recovers the dropped one from the unit norm. Consecutive samples
+// dropping the same component are then sent as 7 bit deltas of the quantized
+// values, which is lossless, so the error never exceeds the keyframe one: half
+// a step, 1/sqrt(2) / 2047 / 2 (~1.7e-4), on the three sent components and at
+// most three times that on the recovered one.
+//
+// The bit stream is packed LSB first, every sample is either:
+//   1 bit  1 (keyframe)
+//   32 bit timestamp, microseconds
+//   2 bit  index of the dropped component (x, y, z, w)
+//   3x12 bit the other components in order, signed
+// or:
+//   1 bit  0 (delta)
+//   16 bit time since the previous sample, microseconds
+//   3x7 bit difference with the previous components, signed
+//
+// Every stream starts with a keyframe and another one is forced every
+// KEYFRAME_INTERVAL samples, so a decoder can join a stream at any keyframe.
+namespace euler::codec {
+
+static constexpr int COMPONENT_BITS = 12;
+static constexpr int DELTA_BITS = 7;
+static constexpr int DT_BITS = 16;
+static constexpr size_t KEYFRAME_BITS = 1 + 32 + 2 + 3 * COMPONENT_BITS;
+static constexpr size_t DELTA_FRAME_BITS = 1 + DT_BITS + 3 * DELTA_BITS;
+static constexpr uint32_t KEYFRAME_INTERVAL = 32;
+
+// Largest quantized value and the Q14 value it stands for, 1/sqrt(2)
+static constexpr int32_t COMPONENT_MAX = (1 << (COMPONENT_BITS - 1)) - 1;
+static constexpr int32_t COMPONENT_RANGE = 11585;
+
+class BitWriter {
+public:
+    explicit BitWriter(std::span<uint8_t> buf) : buf{buf} {}
+
+    bool fits(size_t bits) const { return pos + bits <= buf.size() * 8; }
+
+    // Callers check fits() first, the value is truncated to its low bits
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, pos++) {
+            uint8_t mask = 1 << (pos % 8);
+            if (value & (1u << i)) {
+                buf[pos / 8] |= mask;
+            } else {
+                buf[pos / 8] &= ~mask;
+            }
+        }
+    }
+
+    size_t bits() const { return pos; }
+    size_t bytes() const { return (pos + 7) / 8; }
+
+private:
+    std::span<uint8_t> buf;
+    size_t pos = 0;
+};
+
+class BitReader {
+public:
+    explicit BitReader(std::span<const uint8_t> buf) : buf{buf} {}
+
+    bool available(size_t bits) const { return pos + bits <= buf.size() * 8; }
+
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; i++, pos++) {
+            if (buf[pos / 8] & (1 << (pos % 8))) value |= 1u << i;
+        }
+        return value;
+    }
+
+    int32_t read_signed(int bits) {
+        uint32_t value = read(bits);
+        // Sign extend
+        uint32_t sign = 1u << (bits - 1);
+        return int32_t(value ^ sign) - int32_t(sign);
+    }
+
+private:
+    std::span<const uint8_t> buf;
+    size_t pos = 0;
+};
+
+// Quantized smallest three representation of a quaternion
+struct Packed {
+    uint8_t index;
+    int16_t values[3];
+
+    bool operator==(const Packed&) const = default;
+
+    static Packed pack(Quat14 q) {
+        int16_t c[4] = {q.x, q.y, q.z, q.w};
+
+        uint8_t index = 0;
+        for (uint8_t i = 1; i < 4; i++) {
+            if (std::abs(c[i]) > std::abs(c[index])) index = i;
+        }
+
+        // q and -q are the same rotation, make the dropped one positive
+        int32_t sign = c[index] < 0 ? -1 : 1;
+        Packed packed{.index = index, .values = {}};
+        for (int i = 0, j = 0; i < 4; i++) {
+            if (i == index) continue;
+            int32_t value = fixed::div_round(sign * c[i] * COMPONENT_MAX,
+                                             COMPONENT_RANGE);
+            packed.values[j++] = int16_t(
+                value > COMPONENT_MAX
+                    ? COMPONENT_MAX
+                    : (value < -COMPONENT_MAX ? -COMPONENT_MAX : value));
+        }
+
+        return packed;
+    }
+
+    Quat14 unpack() const {
+        int32_t c[4] = {};
+        uint32_t sum = 0;
+        for (int i = 0, j = 0; i < 4; i++) {
+            if (i == index) continue;
+            c[i] =
+                fixed::div_round(values[j++] * COMPONENT_RANGE, COMPONENT_MAX);
+            sum += uint32_t(c[i] * c[i]);
+        }
+
+        constexpr uint32_t ONE2 = uint32_t(Quat14::ONE) * Quat14::ONE;
+        c[index] = sum < ONE2 ? int32_t(fixed::isqrt(ONE2 - sum)) : 0;
+
+        return {fixed::saturate(c[0]), fixed::saturate(c[1]),
+                fixed::saturate(c[2]), fixed::saturate(c[3])};
+    }
+};
+
+class Encoder {
+public:
+    // Starts a new stream, the first sample is always a keyframe
+    explicit Encoder(std::span<uint8_t> buf) : writer{buf} {}
+
+    // Returns false, leaving the stream untouched, if the sample doesn't fit
+    bool add(uint32_t timestamp, Quat14 rotation) {
+        Packed packed = Packed::pack(rotation);
+
+        int32_t deltas[3];
+        uint32_t dt = timestamp - last_timestamp;
+        bool delta = count > 0 && since_keyframe < KEYFRAME_INTERVAL &&
+                     packed.index == last.index && dt < (1u << DT_BITS);
+        for (int i = 0; delta && i < 3; i++) {
+            deltas[i] = packed.values[i] - last.values[i];
+            if (std::abs(deltas[i]) >= (1 << (DELTA_BITS - 1))) delta = false;
+        }
+
+        if (delta) {
+            if (!writer.fits(DELTA_FRAME_BITS)) return false;
+
+            writer.write(0, 1);
+            writer.write(dt, DT_BITS);
+            for (int i = 0; i < 3; i++) writer.write(deltas[i], DELTA_BITS);
+            since_keyframe++;
+        } else {
+            if (!writer.fits(KEYFRAME_BITS)) return false;
+
+            writer.write(1, 1);
+            writer.write(timestamp, 32);
+            writer.write(packed.index, 2);
+            for (int i = 0; i < 3; i++)
+                writer.write(packed.values[i], COMPONENT_BITS);
+            since_keyframe = 1;
+        }
+
+        last = packed;
+        last_timestamp = timestamp;
+        count++;
+        return true;
+    }
+
+    size_t samples() const { return count; }
+    size_t bytes() const { return writer.bytes(); }
+
+private:
+    BitWriter writer;
+    Packed last{};
+    uint32_t last_timestamp = 0;
+    uint32_t since_keyframe = 0;
+    size_t count = 0;
+};
+
+class Decoder {
+public:
+    explicit Decoder(std::span<const uint8_t> buf) : reader{buf} {}
+
+    // Decodes the next sample, returns false at the end of the stream or if
+    // it doesn't start with a keyframe. Padding bits at the end are ignored.
+    bool next(uint32_t& timestamp, Quat14& rotation) {
+        if (!reader.available(1)) return false;
+
+        bool keyframe = reader.read(1);
+        if (keyframe) {
+            if (!reader.available(KEYFRAME_BITS - 1)) return false;
+
+            last_timestamp = reader.read(32);
+            last.index = reader.read(2);
+            for (int i = 0; i < 3; i++)
+                last.values[i] = reader.read_signed(COMPONENT_BITS);
+            synced = true;
+        } else {
+            if (!synced || !reader.available(DELTA_FRAME_BITS - 1))
+                return false;
+
+            last_timestamp += reader.read(DT_BITS);
+            for (int i = 0; i < 3; i++)
+                last.values[i] += reader.read_signed(DELTA_BITS);
+        }
+
+        timestamp = last_timestamp;
+        rotation = last.unpack();
+        return true;
+    }
+
+private:
+    BitReader reader;
+    Packed last{};
+    uint32_t last_timestamp = 0;
+    bool synced = false;
+};
+
+}  // namespace euler::codec
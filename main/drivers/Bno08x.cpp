@@ -1,20 +1,101 @@
 #include "Bno08x.hpp"
 
 #include <esp_log.h>
+#include <esp_rom_sys.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
+#include <utils/Boot.hpp>
+#include <utils/Log.hpp>
 
-#include <utils/Defer.hpp>
+#include <algorithm>
 
 static const char *TAG = "Bno08x";
 
 using namespace euler;
 
-Bno08x::Bno08x() : events{xEventGroupCreate()} { assert(events != nullptr); }
+Bno08x::Future::Future(Future &&other)
+    : owner{other.owner}, slot{other.slot} {
+    other.owner = nullptr;
+}
+
+Bno08x::Future &Bno08x::Future::operator=(Future &&other) {
+    if (this != &other) {
+        abandon();
+        owner = other.owner;
+        slot = other.slot;
+        other.owner = nullptr;
+    }
+
+    return *this;
+}
+
+Bno08x::Future::~Future() { abandon(); }
+
+bool Bno08x::Future::wait(TickType_t timeout) {
+    if (owner == nullptr) return false;
+
+    // The service task would never get to complete the command
+    assert(xTaskGetCurrentTaskHandle() != owner->service.handle());
+
+    CompletionSlot &completion = owner->completions[slot];
+    if (xSemaphoreTake(completion.done, timeout) != pdTRUE) return false;
+
+    bool success = completion.success;
+    completion.state.store(CompletionSlot::Free);
+    owner = nullptr;
+
+    return success;
+}
+
+void Bno08x::Future::abandon() {
+    if (owner == nullptr) return;
+
+    CompletionSlot &completion = owner->completions[slot];
+    uint8_t expected = CompletionSlot::Pending;
+    if (!completion.state.compare_exchange_strong(expected,
+                                                  CompletionSlot::Abandoned)) {
+        // The command already completed, consume the result. The service
+        // task marks the slot done before giving the semaphore, the slot is
+        // only free once the give landed, or it would complete the next
+        // command on this slot right away.
+        xSemaphoreTake(completion.done, portMAX_DELAY);
+        completion.state.store(CompletionSlot::Free);
+    }
+
+    owner = nullptr;
+}
+
+Bno08x::Bno08x()
+    : commands{xQueueCreateStatic(COMMAND_QUEUE_LEN, sizeof(Command),
+                                  commands_storage.data(), &commands_buffer)} {
+    assert(commands != nullptr);
+
+    for (CompletionSlot &completion : completions) {
+        completion.done = xSemaphoreCreateBinaryStatic(&completion.done_buffer);
+        assert(completion.done != nullptr);
+    }
+}
 
 bool Bno08x::init(i2c_master_bus_handle_t bus, gpio_num_t intr,
-                  gpio_num_t reset, gpio_num_t bootn) {
+                  gpio_num_t reset, gpio_num_t bootn, uint32_t scl_speed_hz) {
     if (is_init) return false;
 
+    if (scl_speed_hz > MAX_SCL_SPEED_HZ) {
+        ESP_LOGE(TAG, "I2C speed of %lu Hz is not supported", scl_speed_hz);
+        return false;
+    }
+
+    this->bus = bus;
+    this->intr = intr;
+    this->reset = reset;
+    this->bootn = bootn;
+
+    // The device is left running, a suspended one is still configured and
+    // resume() picks it up from there, start() resets it anyway. Its pins may
+    // be held from before a deep sleep, they keep their level once released.
+    gpio_set_level(bootn, 1);
+    gpio_set_level(reset, 1);
+
     gpio_config_t reset_config = {};
     reset_config.pin_bit_mask = (1 << reset) | (1 << bootn);
     reset_config.mode = GPIO_MODE_OUTPUT;
@@ -22,6 +103,8 @@ bool Bno08x::init(i2c_master_bus_handle_t bus, gpio_num_t intr,
     reset_config.pull_up_en = GPIO_PULLUP_DISABLE;
     reset_config.intr_type = GPIO_INTR_DISABLE;
     assert(gpio_config(&reset_config) == ESP_OK);
+    gpio_hold_dis(reset);
+    gpio_hold_dis(bootn);
 
     gpio_config_t intr_config = {};
     intr_config.pin_bit_mask = 1 << intr;
@@ -30,206 +113,821 @@ bool Bno08x::init(i2c_master_bus_handle_t bus, gpio_num_t intr,
     // Keep this at pull-up to keep the line stable when the other device is not
     // actively driving the line
     intr_config.pull_up_en = GPIO_PULLUP_ENABLE;
-    intr_config.intr_type = GPIO_INTR_NEGEDGE;
+    // Edges are missed in light sleep, only a level wakes the chip up. The
+    // ISR masks the interrupt until the cargo is read, see arm_irq().
+    intr_config.intr_type = GPIO_INTR_LOW_LEVEL;
     assert(gpio_config(&intr_config) == ESP_OK);
-    assert(gpio_isr_handler_add(intr, on_irq, events) == ESP_OK);
+    assert(gpio_isr_handler_add(intr, on_irq, this) == ESP_OK);
+    assert(gpio_wakeup_enable(intr, GPIO_INTR_LOW_LEVEL) == ESP_OK);
+
+    // Fails when power management is disabled, there's nothing to hold then
+    transfer_lock.init(ESP_PM_CPU_FREQ_MAX, "bno08x");
 
     i2c_device_config_t dev_config = {};
     dev_config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
     dev_config.device_address = ADDRESS;
-    dev_config.scl_speed_hz = 100'000;
+    dev_config.scl_speed_hz = scl_speed_hz;
     dev_config.scl_wait_us = 0;
     dev_config.flags.disable_ack_check = false;
     assert(i2c_master_bus_add_device(bus, &dev_config, &dev_handle) == ESP_OK);
 
-    // Set the device in reset
-    gpio_set_level(bootn, 0);
-    gpio_set_level(reset, 0);
+    // Transfers complete asynchronously if the bus was created with a
+    // transaction queue, we get notified from the I2C interrupt
+    i2c_master_event_callbacks_t callbacks = {};
+    callbacks.on_trans_done = on_transfer_done;
+    assert(i2c_master_register_event_callbacks(dev_handle, &callbacks, this) ==
+           ESP_OK);
 
-    // Signal the bus as free
-    xEventGroupSetBits(events, FREE_EV);
+    is_init = true;
 
-    // Start up the service handler
-    service.start("Bno08xService", 16 * 1024, 0, [this]() { service_func(); });
+    // Start up the service handler, it owns the device from now on
+    service.start("Bno08xService", Priority::Sensor,
+                  [this]() { service_func(); });
 
-    this->intr = intr;
-    this->reset = reset;
-    this->bootn = bootn;
+    return true;
+}
+
+bool Bno08x::init(bno08x::Replay &replay) {
+    if (is_init) return false;
+
+    if (!replay.valid()) {
+        ESP_LOGE(TAG, "Not a valid SHTP capture");
+        return false;
+    }
+
+    this->replay = &replay;
 
     is_init = true;
+
+    // The service task pulls transfers from the capture as it would from the
+    // device
+    service.start("Bno08xService", Priority::Sensor,
+                  [this]() { service_func(); });
+
     return true;
 }
 
-bool Bno08x::start() {
-    if (!is_init) return false;
+bool Bno08x::set_capture(CaptureSink sink) {
+    // The service task reads it without synchronization
+    if (is_init) return false;
 
-    acquire_bus();
+    capture = std::move(sink);
+    return true;
+}
 
-    // Start up the device
-    gpio_set_level(bootn, 1);
-    gpio_set_level(reset, 1);
+Bno08x::Future Bno08x::start() {
+    return submit({.type = Command::Type::Reset, .timeout = RESET_TIMEOUT});
+}
 
-    // Wait for a "reset complete" message
-    while (1) {
-        recv(portMAX_DELAY, false);
+Bno08x::Future Bno08x::enable_arvr_stabilized_rotation_vector(
+    uint32_t report_interval, uint32_t batch_interval, Consumer consumer) {
+    return submit(
+        {.type = Command::Type::SetFeature,
+         .timeout = COMMAND_TIMEOUT,
+         .feature = {.feature_report_id =
+                         bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR,
+                     .wake_up_enable = false,
+                     .always_on_enable = false,
+                     .report_interval = report_interval,
+                     .batch_interval = batch_interval,
+                     .config_word = 0},
+         .consumer = consumer});
+}
+
+Bno08x::Future Bno08x::release_arvr_stabilized_rotation_vector(
+    Consumer consumer) {
+    return enable_arvr_stabilized_rotation_vector(0, 0, consumer);
+}
+
+Bno08x::Future Bno08x::configure_gyro_integrated_rotation_vector(
+    const bno08x::GyroIntegratedRVConfig &config) {
+    return submit(
+        {.type = Command::Type::WriteFrs,
+         .timeout = COMMAND_TIMEOUT,
+         .record = bno08x::GyroIntegratedRVConfig::to_record(config)});
+}
+
+Bno08x::Future Bno08x::enable_gyro_integrated_rotation_vector(
+    uint32_t report_interval) {
+    return submit(
+        {.type = Command::Type::SetFeature,
+         .timeout = COMMAND_TIMEOUT,
+         .feature = {.feature_report_id =
+                         bno08x::report_id::GYRO_INTEGRATED_ROTATION_VECTOR,
+                     .wake_up_enable = false,
+                     .always_on_enable = false,
+                     .report_interval = report_interval,
+                     .batch_interval = 0,
+                     .config_word = 0}});
+}
+
+Bno08x::Future Bno08x::enable_adaptive_rate(
+    const bno08x::AdaptiveRate::Config &config) {
+    // The stability detector is enabled first, the service task follows up
+    // with the classifier
+    return submit({.type = Command::Type::EnableAdaptiveRate,
+                   .timeout = COMMAND_TIMEOUT,
+                   .rate = config});
+}
 
-        if (header_in.chan == bno08x::channels::EXECUTABLE &&
-            header_in.len == 5 && cargo_in[4] == 1) {
+Bno08x::Future Bno08x::suspend() {
+    return submit({.type = Command::Type::Suspend, .timeout = COMMAND_TIMEOUT});
+}
+
+Bno08x::Future Bno08x::resume(const Snapshot &snapshot) {
+    return submit({.type = Command::Type::Resume,
+                   .timeout = COMMAND_TIMEOUT,
+                   .snapshot = &snapshot});
+}
+
+Bno08x::Future Bno08x::submit(Command command) {
+    if (!is_init) return {};
+
+    // Grab a free completion slot
+    uint8_t slot = 0;
+    while (true) {
+        if (slot == completions.size()) {
+            EULER_LOGE(TAG, "Too many pending commands");
+            return {};
+        }
+
+        uint8_t expected = CompletionSlot::Free;
+        if (completions[slot].state.compare_exchange_strong(
+                expected, CompletionSlot::Pending))
             break;
+
+        slot++;
+    }
+
+    command.slot = slot;
+    if (xQueueSend(commands, &command, 0) != pdTRUE) {
+        EULER_LOGE(TAG, "Command queue is full");
+        completions[slot].state.store(CompletionSlot::Free);
+        return {};
+    }
+
+    xTaskNotify(service.handle(), COMMAND_NOTIFY, eSetBits);
+    return Future{this, slot};
+}
+
+void Bno08x::complete(uint8_t slot, bool success) {
+    if (slot == NO_SLOT) return;
+
+    CompletionSlot &completion = completions[slot];
+    completion.success = success;
+
+    uint8_t expected = CompletionSlot::Pending;
+    if (completion.state.compare_exchange_strong(expected,
+                                                 CompletionSlot::Done)) {
+        xSemaphoreGive(completion.done);
+    } else {
+        // Nobody is waiting for the result anymore
+        completion.state.store(CompletionSlot::Free);
+    }
+}
+
+void Bno08x::service_func() {
+    Command active;
+    bool has_active = false;
+
+    TimeOut_t timer;
+    TickType_t remaining = 0;
+
+    while (1) {
+        // Commands run one at a time, the next one is sent only after the
+        // device answered the previous one. Rate changes go first, a moving
+        // head should get the full rate back as soon as possible.
+        bool apply_rate = !has_active && rate_dirty;
+        if (apply_rate) {
+            rate_dirty = false;
+            active = {.type = Command::Type::ApplyRate,
+                      .slot = NO_SLOT,
+                      .timeout = COMMAND_TIMEOUT};
+        }
+
+        if (apply_rate ||
+            (!has_active && xQueueReceive(commands, &active, 0) == pdTRUE)) {
+            Progress progress = run_command(active);
+            if (progress == Progress::Pending) {
+                has_active = true;
+                remaining = active.timeout;
+                vTaskSetTimeOutState(&timer);
+            } else {
+                complete(active.slot, progress == Progress::Done);
+            }
+
+            continue;
+        }
+
+        if (irq_asserted()) {
+            if (recv(RECV_TIMEOUT)) {
+                // Dispatch the event
+                handle_generic();
+
+                if (has_active) {
+                    Progress progress = on_response(active);
+                    if (progress != Progress::Pending) {
+                        complete(active.slot, progress == Progress::Done);
+                        has_active = false;
+                    }
+                }
+            } else {
+                EULER_LOGE(TAG, "Unexpected internal error while receiving");
+                // TODO: Should we reset the device if too many failures occur?
+            }
         } else {
-            handle_generic();
+            arm_irq();
+            xTaskNotifyWait(0, IRQ_NOTIFY | COMMAND_NOTIFY, nullptr,
+                            has_active ? remaining : portMAX_DELAY);
+        }
+
+        if (has_active && xTaskCheckForTimeOut(&timer, &remaining) == pdTRUE) {
+            EULER_LOGE(TAG, "Timed out waiting for a command response");
+            complete(active.slot, false);
+            has_active = false;
         }
     }
+}
 
-    release_bus();
-    return true;
+Bno08x::Progress Bno08x::expect_response(bool sent) {
+    return sent ? Progress::Pending : Progress::Failed;
 }
 
-bool Bno08x::enable_arvr_stabilized_rotation_vector(uint32_t report_interval) {
-    if (!is_init) return false;
+Bno08x::Progress Bno08x::run_command(Command &command) {
+    switch (command.type) {
+        case Command::Type::Reset:
+            // The device restarts its sequence numbers from scratch, with
+            // every report off
+            reset_state();
+
+            // There is no device behind a replay, the capture goes on
+            if (replay) return Progress::Pending;
+
+            // Held if the device was suspended
+            gpio_hold_dis(reset);
+            gpio_hold_dis(bootn);
+            // A tick long delay could last anywhere up to 10 ms, the pulse
+            // only has to be noticed
+            gpio_set_level(reset, 0);
+            gpio_set_level(bootn, 1);
+            esp_rom_delay_us(RESET_PULSE_US);
+            gpio_set_level(reset, 1);
+            return Progress::Pending;
+
+        case Command::Type::SetFeature:
+            // The rotation vector is shared, what is sent satisfies every
+            // consumer
+            if (command.feature.feature_report_id ==
+                bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR) {
+                state.arvr_claims[size_t(command.consumer)] = {
+                    .report_interval = command.feature.report_interval,
+                    .batch_interval = command.feature.batch_interval};
+                command.feature = claimed_arvr();
+            }
+            return expect_response(send_feature(command.feature));
+
+        case Command::Type::WriteFrs:
+            // Read the current record back first, to avoid wearing out the
+            // device flash with identical writes
+            frs_in = {.type = command.record.type, .len = 0, .words = {}};
+            command.writing = false;
+            return expect_response(send_control(bno08x::FrsReadRequest{
+                .offset = 0, .type = command.record.type, .block_size = 0}));
+
+        case Command::Type::EnableAdaptiveRate:
+            // The detector is only sent on change, the interval just limits
+            // how often
+            command.feature = {
+                .feature_report_id = bno08x::report_id::STABILITY_DETECTOR,
+                .wake_up_enable = false,
+                .always_on_enable = false,
+                .report_interval = STABILITY_DETECTOR_INTERVAL,
+                .batch_interval = 0,
+                .config_word = 0};
+            return expect_response(send_feature(command.feature));
+
+        case Command::Type::ApplyRate:
+            // Nothing to do while the report is off, it is adapted when
+            // enabled again
+            if (!adaptive || arvr_request.report_interval == 0)
+                return Progress::Done;
+
+            command.feature = adaptive->adapt(arvr_request);
+            EULER_LOGI(TAG, "Rotation vector interval set to %lu us, batch "
+                       "interval to %lu us",
+                       command.feature.report_interval,
+                       command.feature.batch_interval);
+            return expect_response(send_control(command.feature));
+
+        case Command::Type::Suspend:
+            // Only a reset is ever answered on this channel
+            if (!send(bno08x::channels::EXECUTABLE,
+                      bno08x::ExecutableCommand{
+                          .command = bno08x::executable::SLEEP}))
+                return Progress::Failed;
+
+            is_suspended = true;
+            suspended = state;
+            for (size_t i = 0; i < channels.size(); i++) {
+                suspended.seq_in[i] = channels[i].seq_num_in;
+                suspended.seq_out[i] = channels[i].seq_num_out;
+            }
 
-    acquire_bus();
+            // The reset line floats when the chip deep sleeps, and the
+            // device resets on it, see docs/errata.md
+            if (!replay) {
+                gpio_hold_en(reset);
+                gpio_hold_en(bootn);
+            }
 
-    std::array<uint8_t, bno08x::SetFeatureCommand::SIZE> buf;
+            EULER_LOGI(TAG, "Suspended with %d features enabled",
+                       suspended.feature_count);
+            return Progress::Done;
+
+        case Command::Type::Resume: {
+            const Snapshot &snapshot = *command.snapshot;
+
+            // The device carries on where it was, features are recorded again
+            // as they are sent. Sequence numbers are still current if this
+            // driver suspended it, cargos may have been read since the
+            // snapshot, they only come from it after a deep sleep.
+            bool restore = !is_suspended;
+            auto live = channels;
+            reset_state();
+            if (restore) {
+                for (size_t i = 0; i < channels.size(); i++) {
+                    channels[i] = {.seq_num_in = snapshot.seq_in[i],
+                                   .seq_num_out = snapshot.seq_out[i]};
+                }
+            } else {
+                channels = live;
+            }
 
-    bno08x::Header header{
-        .len = buf.size(),
-        .chan = bno08x::channels::SH2_CONTROL,
-        .seq = channels[bno08x::channels::SH2_CONTROL].seq_num_out++};
+            // Starts at the full rate, the head is most likely moving if it
+            // woke the tracker up
+            if (snapshot.adaptive) {
+                adaptive.emplace(snapshot.rate);
+                state.adaptive = true;
+                state.rate = snapshot.rate;
+            }
+            state.arvr_claims = snapshot.arvr_claims;
+
+            if (!send(bno08x::channels::EXECUTABLE,
+                      bno08x::ExecutableCommand{
+                          .command = bno08x::executable::ON}))
+                return Progress::Failed;
+
+            // Sensors may not come back on their own, they are enabled again
+            // one at a time, the first samples arrive right after the first
+            // response
+            command.offset = 0;
+            return resume_next(command);
+        }
+    }
 
-    bno08x::SetFeatureCommand command{
-        .feature_report_id = bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR,
-        .wake_up_enable = false,
-        .always_on_enable = false,
-        .report_interval = report_interval,
-        .batch_interval = 0,
-        .config_word = 0};
+    return Progress::Failed;
+}
 
-    bno08x::SetFeatureCommand::write(header, command, buf);
+Bno08x::Progress Bno08x::on_response(Command &command) {
+    switch (command.type) {
+        case Command::Type::Reset:
+            // The SHTP advertisement only says the transport is up, the
+            // SH-2 application may still be starting and miss commands.
+            // "Reset complete" comes from the application itself once it
+            // runs, queued commands go out after it.
+            if (header_in.chan == bno08x::channels::EXECUTABLE &&
+                header_in.len == 5 &&
+                cargo_in[4] == bno08x::executable::RESET_COMPLETE) {
+                boot::mark(boot::Phase::ImuReady);
+                return Progress::Done;
+            }
+            break;
 
-    send_raw(buf);
+        case Command::Type::SetFeature:
+        case Command::Type::ApplyRate:
+        case Command::Type::EnableAdaptiveRate:
+        case Command::Type::Resume:
+            if (header_in.chan != bno08x::channels::SH2_CONTROL ||
+                header_in.len <= 5 ||
+                cargo_in[4] != bno08x::report_id::GET_FEATURE_RESPONSE ||
+                cargo_in[5] != command.feature.feature_report_id)
+                break;
+
+            // The stream period changes with the report interval
+            if (command.feature.feature_report_id ==
+                bno08x::report_id::GYRO_INTEGRATED_ROTATION_VECTOR)
+                girv_clock.reset();
+            if (command.feature.feature_report_id ==
+                bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR)
+                arvr_clock.reset();
+
+            if (command.type == Command::Type::EnableAdaptiveRate) {
+                if (command.feature.feature_report_id ==
+                        bno08x::report_id::STABILITY_DETECTOR &&
+                    command.rate.classifier_interval != 0) {
+                    command.feature.feature_report_id =
+                        bno08x::report_id::STABILITY_CLASSIFIER;
+                    command.feature.report_interval =
+                        command.rate.classifier_interval;
+                    return expect_response(send_feature(command.feature));
+                }
 
-    while (1) {
-        recv(portMAX_DELAY, false);
+                // Starts at the full rate, which the rotation vector may not
+                // be at if the adaptive rate was already enabled
+                adaptive.emplace(command.rate);
+                rate_dirty = true;
+                state.adaptive = true;
+                state.rate = command.rate;
+            }
 
-        if (header_in.chan == bno08x::channels::SH2_CONTROL &&
-            header_in.len > 4 &&
-            cargo_in[4] == bno08x::report_id::GET_FEATURE_RESPONSE) {
+            if (command.type == Command::Type::Resume)
+                return resume_next(command);
+
+            return Progress::Done;
+
+        case Command::Type::Suspend:
+            // Done as soon as sent
+            break;
+
+        case Command::Type::WriteFrs:
+            if (header_in.chan == bno08x::channels::SH2_CONTROL &&
+                header_in.len > 4)
+                return on_frs_response(command);
             break;
-        } else {
-            handle_generic();
-        }
     }
 
-    release_bus();
-    return true;
+    return Progress::Pending;
 }
 
-void Bno08x::service_func() {
-    while (1) {
-        // Receive the data and acquire the bus
-        if (!recv(portMAX_DELAY, true)) {
-            // We release the bus anyway, even if we didn't acquire it, it's
-            // safe
-            release_bus();
-
-            ESP_LOGE(TAG, "Unexpected internal error while receiving");
-            // TODO: Should we reset the device if too many failures occur?
+Bno08x::Progress Bno08x::resume_next(Command &command) {
+    const Snapshot &snapshot = *command.snapshot;
+    if (command.offset >= snapshot.feature_count) {
+        EULER_LOGI(TAG, "Resumed with %d features enabled",
+                   state.feature_count);
+        boot::mark(boot::Phase::ImuReady);
+        return Progress::Done;
+    }
+
+    command.feature = snapshot.features[command.offset++];
+    return expect_response(send_feature(command.feature));
+}
+
+void Bno08x::reset_state() {
+    channels = {};
+    recv_hint = bno08x::Header::SIZE;
+    arvr_clock.reset();
+    girv_clock.reset();
+    arvr_request.report_interval = 0;
+    arvr_request.batch_interval = 0;
+    adaptive.reset();
+    rate_dirty = false;
+    state = {};
+    is_suspended = false;
+}
+
+bno08x::SetFeatureCommand Bno08x::claimed_arvr() const {
+    bno08x::SetFeatureCommand feature = arvr_request;
+    feature.report_interval = 0;
+    feature.batch_interval = 0;
+
+    // The fastest report, delivered as soon as the most impatient consumer
+    // wants it, a batch interval of zero being the most impatient
+    bool claimed = false;
+    for (const Claim &claim : state.arvr_claims) {
+        if (claim.report_interval == 0) continue;
+
+        if (!claimed) {
+            feature.report_interval = claim.report_interval;
+            feature.batch_interval = claim.batch_interval;
+            claimed = true;
             continue;
         }
 
-        // Dispatch the event
-        handle_generic();
+        feature.report_interval =
+            std::min(feature.report_interval, claim.report_interval);
+        feature.batch_interval =
+            std::min(feature.batch_interval, claim.batch_interval);
+    }
+
+    return feature;
+}
+
+bool Bno08x::send_feature(bno08x::SetFeatureCommand feature) {
+    remember_feature(feature);
+
+    // The adaptive rate applies on top of the requested intervals
+    if (feature.feature_report_id ==
+        bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR) {
+        arvr_request = feature;
+        if (adaptive) feature = adaptive->adapt(arvr_request);
+    }
+
+    return send_control(feature);
+}
+
+void Bno08x::remember_feature(const bno08x::SetFeatureCommand &feature) {
+    auto begin = state.features.begin();
+    auto end = begin + state.feature_count;
+    auto it = std::find_if(begin, end, [&](const auto &enabled) {
+        return enabled.feature_report_id == feature.feature_report_id;
+    });
+
+    // Disabled features are not restored
+    if (feature.report_interval == 0) {
+        if (it != end) {
+            std::copy(it + 1, end, it);
+            state.feature_count--;
+        }
+        return;
+    }
+
+    if (it == end) {
+        if (state.feature_count == state.features.size()) {
+            EULER_LOGE(TAG, "Too many features to restore, dropping report: %x",
+                       feature.feature_report_id);
+            return;
+        }
 
-        // Release the bus for other functions
-        release_bus();
+        state.feature_count++;
     }
+
+    *it = feature;
+}
+
+Bno08x::Progress Bno08x::on_frs_response(Command &command) {
+    const bno08x::FrsRecord &record = command.record;
+    std::span<const uint8_t> cargo{cargo_in.begin() + 4, header_in.len - 4u};
+
+    if (!command.writing &&
+        cargo[0] == bno08x::report_id::FRS_REQ_RESPONSE &&
+        cargo.size() >= bno08x::FrsReadResponse::SIZE) {
+        using Response = bno08x::FrsReadResponse;
+        Response response = Response::read(cargo);
+        if (response.type != record.type) return Progress::Pending;
+
+        switch (response.status) {
+            case Response::NO_ERROR:
+            case Response::BLOCK_COMPLETED:
+            case Response::READ_COMPLETED:
+            case Response::BLOCK_AND_RECORD_COMPLETED:
+                for (size_t i = 0; i < std::min<size_t>(response.len, 2); i++) {
+                    size_t off = response.offset + i;
+                    if (off >= frs_in.words.size()) continue;
+
+                    frs_in.words[off] = response.data[i];
+                    frs_in.len = std::max<size_t>(frs_in.len, off + 1);
+                }
+
+                if (response.status == Response::NO_ERROR ||
+                    response.status == Response::BLOCK_COMPLETED)
+                    return Progress::Pending;
+                break;
+
+            case Response::RECORD_EMPTY:
+                break;
+
+            default:
+                EULER_LOGE(TAG, "FRS read of %x failed with status: %d",
+                           record.type, response.status);
+                return Progress::Failed;
+        }
+
+        if (frs_in.len == record.len &&
+            std::equal(record.words.begin(), record.words.begin() + record.len,
+                       frs_in.words.begin())) {
+            EULER_LOGI(TAG, "FRS record %x is up to date", record.type);
+            return Progress::Done;
+        }
+
+        EULER_LOGI(TAG, "Writing FRS record %x", record.type);
+        command.writing = true;
+        command.offset = 0;
+        return expect_response(send_control(
+            bno08x::FrsWriteRequest{.len = record.len, .type = record.type}));
+    }
+
+    if (command.writing &&
+        cargo[0] == bno08x::report_id::FRS_WRITE_RESPONSE &&
+        cargo.size() >= bno08x::FrsWriteResponse::SIZE) {
+        using Response = bno08x::FrsWriteResponse;
+        Response response = Response::read(cargo);
+
+        switch (response.status) {
+            case Response::WORDS_RECEIVED:
+                command.offset += 2;
+                [[fallthrough]];
+
+            case Response::WRITE_READY: {
+                // Words are sent two at a time, the device ignores any word
+                // past the record length
+                if (command.offset >= record.len) return Progress::Pending;
+
+                uint32_t second = command.offset + 1 < record.len
+                                      ? record.words[command.offset + 1]
+                                      : 0;
+                bno08x::FrsWriteData data{
+                    .offset = command.offset,
+                    .data = {record.words[command.offset], second}};
+                return expect_response(send_control(data));
+            }
+
+            case Response::WRITE_COMPLETED:
+            case Response::RECORD_VALID:
+                return Progress::Done;
+
+            default:
+                EULER_LOGE(TAG, "FRS write of %x failed with status: %d",
+                           record.type, response.status);
+                return Progress::Failed;
+        }
+    }
+
+    return Progress::Pending;
+}
+
+template <typename Message>
+bool Bno08x::send(uint8_t chan, Message message) {
+    std::array<uint8_t, Message::SIZE> buf;
+
+    bno08x::Header header{
+        .len = buf.size(), .chan = chan, .seq = channels[chan].seq_num_out++};
+
+    Message::write(header, message, buf);
+    return send_raw(buf);
+}
+
+template <typename Message>
+bool Bno08x::send_control(Message message) {
+    return send(bno08x::channels::SH2_CONTROL, message);
 }
 
 void Bno08x::handle_generic() {
+    uint32_t published = sample_ring.published();
+
     if (header_in.chan == bno08x::channels::INPUT_SENSOR_REPORTS ||
         header_in.chan == bno08x::channels::WAKE_INPUT_SENSOR_REPORTS) {
-        // Process sensor data
-        size_t off = 4;
-        while ((header_in.len - off) >= 1) {
-            if (cargo_in[off] == bno08x::report_id::BASE_TIMESTAMP) {
-                // Base timestamp packet
-                if ((header_in.len - off) <
-                    bno08x::BaseTimestampReference::SIZE) {
-                    ESP_LOGE(TAG,
-                             "Invalid size for BaseTimestampReference packet");
-                    return;
-                }
+        // Process sensor data, every cargo starts with a fresh reference
+        timebase.begin_cargo(cargo_in_time);
 
-                auto packet = bno08x::BaseTimestampReference::read(
-                    {cargo_in.begin() + off, cargo_in.end()});
-                ESP_LOGI(TAG, "Received BaseTimestampReference, base_delta: %lu",
-                         packet.base_delta);
-
-                off += bno08x::BaseTimestampReference::SIZE;
-            } else if (cargo_in[off] == bno08x::report_id::TIMESTAMP_REBASE) {
-                // Rebase timestamp packet
-                if ((header_in.len - off) <
-                    bno08x::RebaseTimestampReference::SIZE) {
-                    ESP_LOGE(
-                        TAG,
-                        "Invalid size for RebaseTimestampReference packet");
-                    return;
-                }
+        std::span<const uint8_t> reports{cargo_in.begin() + 4,
+                                         header_in.len - 4u};
 
-                
-                auto packet = bno08x::RebaseTimestampReference::read(
-                    {cargo_in.begin() + off, cargo_in.end()});
-                    ESP_LOGI(TAG,
-                        "Received RebaseTimestampReference, rebase_delta: %lu",
-                        packet.rebase_delta);
-            
-                        off += bno08x::RebaseTimestampReference::SIZE;
-            } else if (cargo_in[off] ==
-                       bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR) {
-                // Rebase timestamp packet
-                if ((header_in.len - off) <
-                    bno08x::ARVRStabilizedRotationVector::SIZE) {
-                    ESP_LOGE(
-                        TAG,
-                        "Invalid size for ARVRStabilizedRotationVector packet");
-                    return;
-                }
+        size_t off = ReportDispatcher::dispatch(*this, reports);
+        trace::record(trace::Stage::Parse, cargo_in_stamp);
 
-                
-                auto packet = bno08x::ARVRStabilizedRotationVector::read(
-                    {cargo_in.begin() + off, cargo_in.end()});
-                    ESP_LOGI(TAG,
-                        "Received ARVRStabilizedRotationVector, x: %f, y: %f, "
-                        "z: %f, w: %f",
-                        packet.x, packet.y, packet.z, packet.w);
-                        off += bno08x::ARVRStabilizedRotationVector::SIZE;
+        if (off < reports.size()) {
+            if (ReportDispatcher::size_of(reports[off]) == 0) {
+                EULER_LOGW(TAG, "Unknown input report id: %x", reports[off]);
             } else {
-                ESP_LOGW(TAG, "Bruh: %d", cargo_in[off]);
-                return;
+                EULER_LOGE(TAG, "Truncated input report id: %x", reports[off]);
             }
         }
     }
 
+    if (header_in.chan == bno08x::channels::GYRO_ROTATION_VECTOR) {
+        // Reports on this channel have a fixed size and no report id
+        using Report = bno08x::GyroIntegratedRotationVector;
+        timebase.begin_cargo(cargo_in_time);
+        for (size_t off = 4; off + Report::SIZE <= header_in.len;
+             off += Report::SIZE) {
+            on_report(
+                Report::read({cargo_in.begin() + off, Report::SIZE}));
+        }
+
+        trace::record(trace::Stage::Parse, cargo_in_stamp);
+    }
+
+    // The head may have settled since the last stability report
+    if (adaptive) update_rate(adaptive->poll(cargo_in_time));
+
+    // Wake up consumers once per cargo, not once per sample
+    if (sample_ring.published() != published) {
+        boot::mark(boot::Phase::FirstSample);
+
+        size_t count = listener_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
+            xTaskNotify(listeners[i].task, listeners[i].bits, eSetBits);
+    }
+
     if (header_in.chan == bno08x::channels::SH2_CONTROL &&
         header_in.len == 20 &&
         cargo_in[4] == bno08x::report_id::COMMAND_RESPONSE) {
         // This is a command response
-        ESP_LOGI(TAG, "Received a cargo on chan %d, len: %d, command id: %x",
-                 header_in.chan, header_in.len, cargo_in[6] & 0x7f);
+        EULER_LOGD(TAG, "Received a cargo on chan %d, len: %d, command id: %x",
+                   header_in.chan, header_in.len, cargo_in[6] & 0x7f);
     } else if ((header_in.chan == bno08x::channels::SH2_CONTROL ||
                 header_in.chan == bno08x::channels::INPUT_SENSOR_REPORTS ||
                 header_in.chan ==
                     bno08x::channels::WAKE_INPUT_SENSOR_REPORTS) &&
                header_in.len >= 5) {
         // This is a generic SH2 control message
-        ESP_LOGI(TAG, "Received a cargo on chan %d, len: %d, report id: %x",
-                 header_in.chan, header_in.len, cargo_in[4]);
+        EULER_LOGD(TAG, "Received a cargo on chan %d, len: %d, report id: %x",
+                   header_in.chan, header_in.len, cargo_in[4]);
     } else {
         // This is a generic command
-        ESP_LOGI(TAG, "Received a cargo on chan %d, len: %d", header_in.chan,
-                 header_in.len);
+        EULER_LOGD(TAG, "Received a cargo on chan %d, len: %d", header_in.chan,
+                   header_in.len);
+    }
+}
+
+void Bno08x::on_report(const bno08x::BaseTimestampReference &report) {
+    EULER_LOGD(TAG, "Received BaseTimestampReference, base_delta: %ld",
+               report.base_delta);
+
+    // The base delta is how long before the interrupt the batch starts
+    timebase.on_base(report.base_delta);
+}
+
+void Bno08x::on_report(const bno08x::RebaseTimestampReference &report) {
+    EULER_LOGD(TAG, "Received RebaseTimestampReference, rebase_delta: %ld",
+               report.rebase_delta);
+
+    // Emitted when the following delays would not fit in 14 bits anymore
+    timebase.on_rebase(report.rebase_delta);
+}
+
+void Bno08x::on_report(const bno08x::ARVRStabilizedRotationVector &report) {
+    EULER_LOGD(TAG,
+               "Received ARVRStabilizedRotationVector, x: %d, y: %d, z: %d, "
+               "w: %d (Q14)",
+               report.rotation.x, report.rotation.y, report.rotation.z,
+               report.rotation.w);
+
+    last_accuracy = report.accuracy;
+    last_status = report.common.status;
+
+    int64_t timestamp = arvr_clock.stamp(timebase, report.common.delay);
+    drift_ppm.store(arvr_clock.drift_ppm().value_or(UNKNOWN_DRIFT),
+                    std::memory_order_relaxed);
+
+    // Only the service task ever publishes samples
+    sample_ring.publish(
+        {.timestamp = timestamp,
+         .rotation = report.rotation,
+         .angular_velocity = {},
+         .accuracy = report.accuracy,
+         .status = report.common.status,
+         .source = Sample::Source::ARVRStabilizedRotationVector,
+         .irq_stamp = cargo_in_stamp});
+    trace::record(trace::Stage::Publish, cargo_in_stamp);
+}
+
+void Bno08x::on_report(const bno08x::GyroIntegratedRotationVector &report) {
+    // There's no delay field, the report is sent as soon as it is computed
+    sample_ring.publish(
+        {.timestamp = girv_clock.stamp(timebase, 0),
+         .rotation = report.rotation,
+         .angular_velocity = report.angular_velocity,
+         .accuracy = last_accuracy,
+         .status = last_status,
+         .source = Sample::Source::GyroIntegratedRotationVector,
+         .irq_stamp = cargo_in_stamp});
+    trace::record(trace::Stage::Publish, cargo_in_stamp);
+}
+
+void Bno08x::on_report(const bno08x::StabilityClassifier &report) {
+    EULER_LOGD(TAG, "Received StabilityClassifier, classification: %d",
+               int(report.classification));
+
+    if (adaptive) update_rate(adaptive->on_report(report, cargo_in_time));
+}
+
+void Bno08x::on_report(const bno08x::StabilityDetector &report) {
+    EULER_LOGD(TAG, "Received StabilityDetector, state: %x", report.state);
+
+    if (adaptive) update_rate(adaptive->on_report(report, cargo_in_time));
+}
+
+void Bno08x::update_rate(bno08x::AdaptiveRate::Change change) {
+    if (change == bno08x::AdaptiveRate::Change::None) return;
+
+    if (change == bno08x::AdaptiveRate::Change::SlowDown) {
+        EULER_LOGD(TAG, "Head is still, slowing the rotation vector down");
+    } else {
+        EULER_LOGD(TAG, "Head is moving, restoring the rotation vector rate");
+    }
+
+    // Sent by the service loop once the active command, if any, is done
+    rate_dirty = true;
+}
+
+bool Bno08x::add_listener(TaskHandle_t task, uint32_t bits) {
+    // Only the service task reads the list, slots are never reused
+    size_t count = listener_count.load(std::memory_order_relaxed);
+    if (count >= listeners.size()) {
+        EULER_LOGE(TAG, "Too many sample listeners");
+        return false;
     }
+
+    listeners[count] = {.task = task, .bits = bits};
+    listener_count.store(count + 1, std::memory_order_release);
+    return true;
+}
+
+std::optional<int32_t> Bno08x::clock_drift_ppm() const {
+    int32_t drift = drift_ppm.load(std::memory_order_relaxed);
+    if (drift == UNKNOWN_DRIFT) return std::nullopt;
+    return drift;
 }
 
 const char *Bno08x::device_error_to_str(uint8_t code) {
@@ -276,114 +974,268 @@ const char *Bno08x::device_error_to_str(uint8_t code) {
     }
 }
 
-bool Bno08x::recv(TickType_t timeout, bool acquire_bus) {
+bool Bno08x::recv(TickType_t timeout) {
     TimeOut_t timer;
     vTaskSetTimeOutState(&timer);
 
-    // Read out the header
-    std::array<uint8_t, 4> header;
-    if (!recv_raw(header, timeout, acquire_bus)) return false;
+    // Speculatively read as much as the last cargo in a single transfer, most
+    // of the traffic is made of same sized cargos
+    size_t len = std::clamp<size_t>(recv_hint, bno08x::Header::SIZE,
+                                    cargo_in.size());
+    if (!recv_raw({cargo_in.begin(), len}, timeout)) return false;
+    cargo_in_time = irq_in_time;
+    cargo_in_stamp = irq_in_stamp;
 
     // Decode the header
-    header_in = bno08x::Header::read(header);
+    header_in = bno08x::Header::read(cargo_in);
+    track_seq_num(header_in);
 
     // Catch initial errors
-    if (header_in.len & 0x8000) {
-        ESP_LOGE(TAG, "SHTP packet continuation is not supported");
+    if (header_in.len & bno08x::Header::CONTINUATION) {
+        // We have no cargo to append this to, the rest of it will keep coming
+        // as continuations which will be dropped as well
+        EULER_LOGE(TAG, "Unexpected SHTP packet continuation");
         return false;
     }
 
     if (header_in.len < 4) {
-        ESP_LOGE(TAG, "SHTP packet too small");
+        EULER_LOGE(TAG, "SHTP packet too small");
         return false;
     }
 
     if (header_in.len > cargo_in.size()) {
-        ESP_LOGE(TAG, "SHTP packet too big");
+        EULER_LOGE(TAG, "SHTP packet too big");
         return false;
     }
 
-    // This is not technically an error, we can recover from this
-    if (header_in.chan >= channels.size()) {
-        ESP_LOGW(TAG, "SHTP channel too big: %d", header_in.chan);
-    } else {
-        // We can no do channel related stuff
-        if (channels[header_in.chan].seq_num_in != header_in.seq)
-            ESP_LOGW(TAG, "SHTP sequence number invalid");
+    // Read the rest of the cargo, every further transfer starts with its own
+    // header, which we read in place and then overwrite with the saved cargo
+    size_t received = std::min<size_t>(len, header_in.len);
+    while (received < header_in.len) {
+        std::span<uint8_t> fragment{
+            cargo_in.begin() + received - bno08x::Header::SIZE,
+            header_in.len - received + bno08x::Header::SIZE};
+
+        std::array<uint8_t, bno08x::Header::SIZE> saved;
+        std::copy_n(fragment.begin(), saved.size(), saved.begin());
+
+        xTaskCheckForTimeOut(&timer, &timeout);
+        if (!recv_raw(fragment, timeout)) return false;
+
+        bno08x::Header header = bno08x::Header::read(fragment);
+        std::copy(saved.begin(), saved.end(), fragment.begin());
+        track_seq_num(header);
+
+        uint16_t fragment_len = header.len & ~bno08x::Header::CONTINUATION;
+        if (!(header.len & bno08x::Header::CONTINUATION) ||
+            header.chan != header_in.chan ||
+            fragment_len <= bno08x::Header::SIZE) {
+            EULER_LOGE(TAG, "Invalid SHTP packet continuation");
+            return false;
+        }
 
-        channels[header_in.chan].seq_num_in = header_in.seq + 2;
+        received += std::min<size_t>(fragment_len, fragment.size()) -
+                    bno08x::Header::SIZE;
     }
 
-    // Read rest of the packet
-    xTaskCheckForTimeOut(&timer, &timeout);
-    if (!recv_raw({cargo_in.begin(), header_in.len}, timeout, false))
-        return false;
-
+    recv_hint = header_in.len;
     return true;
 }
 
-void Bno08x::acquire_bus() {
-    xEventGroupWaitBits(events, FREE_EV, pdTRUE, pdTRUE, portMAX_DELAY);
-}
+void Bno08x::track_seq_num(bno08x::Header header) {
+    // This is not technically an error, we can recover from this
+    if (header.chan >= channels.size()) {
+        EULER_LOGW(TAG, "SHTP channel too big: %d", header.chan);
+        return;
+    }
+
+    // Every transfer, including continuations, has its own sequence number
+    if (channels[header.chan].seq_num_in != header.seq)
+        EULER_LOGW(TAG, "SHTP sequence number invalid on chan %d, got: %d, "
+                   "expected: %d",
+                   header.chan, header.seq, channels[header.chan].seq_num_in);
 
-void Bno08x::release_bus() { xEventGroupSetBits(events, FREE_EV); }
+    channels[header.chan].seq_num_in = header.seq + 1;
+}
 
 bool Bno08x::send_raw(std::span<const uint8_t> buf) {
-    esp_err_t err = i2c_master_transmit(dev_handle, buf.data(), buf.size(), -1);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to write to I2C with err: %d", err);
-        return false;
+    if (capture) {
+        capture({.type = bno08x::CaptureRecord::Type::Write,
+                 .time = esp_timer_get_time(),
+                 .data = buf});
     }
 
+    if (replay) return true;
+
+    begin_transfer();
+
+    esp_err_t err = i2c_master_transmit(dev_handle, buf.data(), buf.size(),
+                                        TRANSFER_TIMEOUT_MS);
+    if (err != ESP_OK)
+        EULER_LOGE(TAG, "Failed to write to I2C with err: %d", err);
+
+    bool ok = err == ESP_OK && wait_for_transfer();
+    end_transfer();
+    return ok;
+}
+
+bool Bno08x::recv_raw(std::span<uint8_t> buf, TickType_t timeout) {
+    if (!wait_for_irq(timeout)) return false;
+
+    trace::record(trace::Stage::I2cStart, irq_in_stamp);
+    bool ok = replay ? replay->read(buf) : receive(buf);
+    if (capture) capture_read(ok, buf);
+    if (!ok) return false;
+
+    trace::record(trace::Stage::I2cEnd, irq_in_stamp);
     return true;
 }
 
-bool Bno08x::recv_raw(std::span<uint8_t> buf, TickType_t timeout,
-                      bool acquire_bus) {
-    if (!wait_for_irq(timeout, acquire_bus)) return false;
+bool Bno08x::receive(std::span<uint8_t> buf) {
+    begin_transfer();
 
-    esp_err_t err = i2c_master_receive(dev_handle, buf.data(), buf.size(), -1);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read from I2C with err: %d", err);
-        return false;
+    esp_err_t err = i2c_master_receive(dev_handle, buf.data(), buf.size(),
+                                       TRANSFER_TIMEOUT_MS);
+    if (err != ESP_OK)
+        EULER_LOGE(TAG, "Failed to read from I2C with err: %d", err);
+
+    bool ok = err == ESP_OK && wait_for_transfer();
+    end_transfer();
+
+    // The read released the line, the interrupt can catch the next cargo
+    // and stamp it on time
+    arm_irq();
+    return ok;
+}
+
+void Bno08x::capture_read(bool ok, std::span<const uint8_t> buf) {
+    if (!ok) {
+        capture({.type = bno08x::CaptureRecord::Type::Error,
+                 .time = irq_in_time,
+                 .data = {}});
+        return;
     }
 
-    return true;
+    // Past the length in its header the transfer is padding
+    uint16_t len =
+        bno08x::Header::read(buf).len & ~bno08x::Header::CONTINUATION;
+    capture({.type = bno08x::CaptureRecord::Type::Read,
+             .time = irq_in_time,
+             .data = buf.first(std::clamp<size_t>(len, bno08x::Header::SIZE,
+                                                  buf.size()))});
 }
 
-bool Bno08x::wait_for_irq(TickType_t timeout, bool acquire_bus) {
-    if (!is_init) return false;
+void Bno08x::begin_transfer() {
+    transfer_lock.acquire();
+
+    // Drop any completion left over from a transfer that timed out
+    ulTaskNotifyValueClear(nullptr, TRANSFER_NOTIFY);
+}
 
+void Bno08x::end_transfer() { transfer_lock.release(); }
+
+bool Bno08x::wait_for_transfer() {
+    TickType_t timeout = pdMS_TO_TICKS(TRANSFER_TIMEOUT_MS);
     TimeOut_t timer;
     vTaskSetTimeOutState(&timer);
 
-    // Check if the signal is already low
     while (1) {
-        // Wait for the interrupt
-        EventBits_t bits =
-            xEventGroupWaitBits(events, acquire_bus ? IRQ_EV | FREE_EV : IRQ_EV,
-                                pdTRUE, pdTRUE, timeout);
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, TRANSFER_NOTIFY, &bits, timeout);
 
-        if (gpio_get_level(intr) == 0) {
-            return true;
-        }
+        if (bits & TRANSFER_NOTIFY) break;
 
         if (xTaskCheckForTimeOut(&timer, &timeout) == pdTRUE) {
+            EULER_LOGE(TAG, "I2C transfer timed out, recovering the bus");
+            recover_bus();
             return false;
         }
+    }
 
-        // If we successfully acquired the bus, just release it
-        if (acquire_bus && (bits & FREE_EV) != 0) {
-            xEventGroupSetBits(events, FREE_EV);
-        }
+    if (transfer_event != I2C_EVENT_DONE) {
+        EULER_LOGE(TAG, "I2C transfer failed with event: %d", transfer_event);
+        return false;
+    }
+
+    return true;
+}
+
+void Bno08x::recover_bus() {
+    // Flush whatever is still queued, then clock SCL until the device
+    // releases SDA and issue a stop condition
+    i2c_master_bus_wait_all_done(bus, TRANSFER_TIMEOUT_MS);
+    esp_err_t err = i2c_master_bus_reset(bus);
+    if (err != ESP_OK) {
+        EULER_LOGE(TAG, "Failed to recover the I2C bus with err: %d", err);
+    }
+}
+
+bool Bno08x::irq_asserted() const {
+    if (replay) return replay->pending();
+    return gpio_get_level(intr) == 0;
+}
+
+void Bno08x::arm_irq() {
+    // Fires right away if the line is already low
+    if (!replay) gpio_intr_enable(intr);
+}
+
+bool Bno08x::wait_for_irq(TickType_t timeout) {
+    if (replay) {
+        // Samples are stamped with the recorded interrupt, latencies are
+        // still measured from now
+        if (!replay->wait_for_read(timeout, irq_in_time)) return false;
+        irq_in_stamp = trace::now();
+        return true;
     }
+
+    TimeOut_t timer;
+    vTaskSetTimeOutState(&timer);
+
+    // The line stays low until the cargo is read out, this also catches
+    // interrupts that fired before we started waiting
+    while (gpio_get_level(intr) != 0) {
+        if (xTaskCheckForTimeOut(&timer, &timeout) == pdTRUE) return false;
+
+        arm_irq();
+        xTaskNotifyWait(0, IRQ_NOTIFY, nullptr, timeout);
+    }
+
+    // The ISR runs on this same core, just retry if it preempted the read
+    int64_t time;
+    do {
+        time = irq_time;
+    } while (time != irq_time);
+
+    irq_in_time = time;
+    irq_in_stamp = uint32_t(time);
+    return true;
 }
 
 void Bno08x::on_irq(void *that) {
-    EventGroupHandle_t *events = reinterpret_cast<EventGroupHandle_t *>(that);
+    Bno08x *self = reinterpret_cast<Bno08x *>(that);
     BaseType_t higher_priority_task_woken = pdFALSE;
-    if (xEventGroupSetBitsFromISR(events, IRQ_EV,
-                                  &higher_priority_task_woken) != pdFAIL) {
+
+    self->irq_time = esp_timer_get_time();
+    // The interrupt is level triggered, it would keep firing until the read
+    gpio_intr_disable(self->intr);
+
+    TaskHandle_t service_task = self->service.handle();
+    if (service_task != nullptr) {
+        xTaskNotifyFromISR(service_task, IRQ_NOTIFY, eSetBits,
+                           &higher_priority_task_woken);
         portYIELD_FROM_ISR(higher_priority_task_woken);
     }
+}
+
+bool Bno08x::on_transfer_done(i2c_master_dev_handle_t dev,
+                              const i2c_master_event_data_t *data, void *that) {
+    Bno08x *self = reinterpret_cast<Bno08x *>(that);
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    self->transfer_event = data->event;
+    xTaskNotifyFromISR(self->service.handle(), TRANSFER_NOTIFY, eSetBits,
+                       &higher_priority_task_woken);
+
+    return higher_priority_task_woken == pdTRUE;
 }
\ No newline at end of file
@@ -3,56 +3,357 @@
 #include <driver/gpio.h>
 #include <driver/i2c_master.h>
 #include <freertos/FreeRTOS.h>
+#include <power/Power.hpp>
+#include <utils/Fixed.hpp>
+#include <utils/SampleRing.hpp>
 #include <utils/Tasklet.hpp>
+#include <utils/Trace.hpp>
 
 #include <array>
+#include <atomic>
+#include <functional>
+#include <optional>
 #include <span>
 
+#include "Bno08xCapture.hpp"
 #include "Bno08xProto.hpp"
+#include "Bno08xRate.hpp"
+#include "Bno08xReplay.hpp"
+#include "Bno08xTimebase.hpp"
 
 namespace euler {
 
+namespace bench {
+class DriverBench;
+}
+
 class Bno08x {
 public:
+    // Decoded orientation sample, as published to consumers
+    struct Sample {
+        enum class Source : uint8_t {
+            ARVRStabilizedRotationVector,
+            GyroIntegratedRotationVector,
+        };
+
+        // Host time at which the sample was taken, in microseconds
+        int64_t timestamp;
+        // Orientation quaternion
+        Quat14 rotation;
+        // Angular velocity in radians per second, Q10. Only provided by the
+        // gyro integrated rotation vector, zero otherwise.
+        std::array<int16_t, 3> angular_velocity;
+        // Estimated heading accuracy in radians, Q12. Gyro integrated samples
+        // carry the accuracy and status of the last rotation vector report.
+        int16_t accuracy;
+        bno08x::SensorReportCommon::Status status;
+        Source source;
+        // trace::now() of the interrupt that delivered the sample, transports
+        // record their trace::Stage::Send latency against it
+        uint32_t irq_stamp;
+    };
+
+    using Samples = SampleRing<Sample, 64>;
+
+    // Consumers of the rotation vector. Each one asks for its own intervals,
+    // the device runs at the shortest ones asked and the report is only
+    // turned off once none of them wants it.
+    enum class Consumer : uint8_t {
+        // Whoever set the driver up, the stream to the tracker app uses it
+        Default,
+        Hid,
+    };
+
+    static constexpr size_t CONSUMER_COUNT = 2;
+
+    // Intervals a consumer asked for, zero if it doesn't want the report
+    struct Claim {
+        uint32_t report_interval;
+        uint32_t batch_interval;
+    };
+
+    // What it takes to bring a suspended device back without a reset: the
+    // features enabled since the last start(), with the intervals that were
+    // requested, and the SHTP sequence numbers. Plain data, it can be kept in
+    // RTC memory through deep sleep.
+    struct Snapshot {
+        static constexpr size_t MAX_FEATURES = 6;
+
+        std::array<bno08x::SetFeatureCommand, MAX_FEATURES> features;
+        uint8_t feature_count;
+        // Whether the adaptive rate was enabled, and its configuration
+        bool adaptive;
+        bno08x::AdaptiveRate::Config rate;
+        // What every consumer asked of the rotation vector
+        std::array<Claim, CONSUMER_COUNT> arvr_claims;
+        std::array<uint8_t, bno08x::channels::COUNT> seq_in;
+        std::array<uint8_t, bno08x::channels::COUNT> seq_out;
+    };
+
+    // Receives every transfer with the device, see bno08x::CaptureRecord
+    using CaptureSink = std::function<void(const bno08x::CaptureRecord&)>;
+
+    // Fast Mode, the fastest speed supported by the device over I2C
+    static constexpr uint32_t MAX_SCL_SPEED_HZ = 400'000;
+
+    // Completion of a command queued to the service task. Dropping a pending
+    // future is fine, the command still runs but its result is discarded.
+    class Future {
+    public:
+        Future() {}
+        Future(const Future&) = delete;
+        Future(Future&& other);
+        Future& operator=(Future&& other);
+        ~Future();
+
+        // Wait for the command to complete, returns true only if it completed
+        // successfully. On timeout the future stays pending and can be waited
+        // on again.
+        bool wait(TickType_t timeout);
+
+        // True if the command was queued and has not been waited on yet
+        bool pending() const { return owner != nullptr; }
+
+    private:
+        friend class Bno08x;
+        Future(Bno08x* owner, uint8_t slot) : owner{owner}, slot{slot} {}
+
+        void abandon();
+
+        Bno08x* owner = nullptr;
+        uint8_t slot = 0;
+    };
+
     Bno08x();
+    // The bus should be created with a non zero trans_queue_depth, this makes
+    // transfers asynchronous and lets the service task sleep through them
     bool init(i2c_master_bus_handle_t bus, gpio_num_t intr, gpio_num_t reset,
-              gpio_num_t bootn);
+              gpio_num_t bootn, uint32_t scl_speed_hz = MAX_SCL_SPEED_HZ);
+    // Runs the driver on a capture instead of the device. Commands are
+    // accepted but nothing is sent, their responses come from the capture.
+    bool init(bno08x::Replay& replay);
+
+    // The sink is called from the service task and must not block, it has to
+    // be set before init()
+    bool set_capture(CaptureSink sink);
 
-    bool start();
-    bool enable_arvr_stabilized_rotation_vector(uint32_t report_interval);
+    // Commands are executed in order by the service task, which keeps handling
+    // sensor reports while waiting for their responses. They return an invalid
+    // future if the driver is not initialized or the queue is full.
+    Future start();
+    // Intervals are in microseconds. A non zero batch interval lets the device
+    // accumulate samples and deliver them in a single cargo, which is
+    // delivered at most batch_interval after the first sample was taken.
+    // An interval of zero is the same as a release.
+    Future enable_arvr_stabilized_rotation_vector(
+        uint32_t report_interval, uint32_t batch_interval = 0,
+        Consumer consumer = Consumer::Default);
+    // Drops the claim of a consumer on the rotation vector, which is turned
+    // off if it was the last one
+    Future release_arvr_stabilized_rotation_vector(Consumer consumer);
+    // The configuration lives in the device flash, it is read back first and
+    // only rewritten if it differs. Must be done before enabling the report.
+    Future configure_gyro_integrated_rotation_vector(
+        const bno08x::GyroIntegratedRVConfig& config);
+    // Reports are delivered on their own channel with the lowest latency the
+    // device can offer, batching is not supported for this report
+    Future enable_gyro_integrated_rotation_vector(uint32_t report_interval);
+    // Enables the stability reports and slows the rotation vector down while
+    // the device is still. The rotation vector keeps its requested intervals
+    // otherwise, they can still be changed at any time. Like the reports, it
+    // has to be enabled again after start().
+    Future enable_adaptive_rate(const bno08x::AdaptiveRate::Config& config);
+
+    // Puts the device to sleep and holds its reset and boot pins, so that it
+    // stays configured while the chip deep sleeps. What is needed to resume
+    // it is returned by snapshot() once the command completed.
+    Future suspend();
+    Snapshot snapshot() const { return suspended; }
+    // Turns a suspended device back on and enables its features again, which
+    // is much faster than a start(). The snapshot has to outlive the command.
+    // Fails if the device doesn't answer, start() is the way back then.
+    Future resume(const Snapshot& snapshot);
+
+    // Stream of decoded samples, consumers should attach a Samples::Reader
+    const Samples& samples() const { return sample_ring; }
+    // Sets the given notification bits of a task every time a cargo produced
+    // new samples, so consumers don't have to poll. Listeners can't be
+    // removed, they should all be added from the same task.
+    bool add_listener(TaskHandle_t task, uint32_t bits);
+
+    // Drift of the device clock relative to esp_timer, in parts per million.
+    // It is measured from the spacing of batched rotation vector reports, so
+    // it is only known once batching has been enabled for a while.
+    std::optional<int32_t> clock_drift_ppm() const;
 
 private:
+    using ReportDispatcher =
+        bno08x::ReportDispatcher<Bno08x, bno08x::BaseTimestampReference,
+                                 bno08x::RebaseTimestampReference,
+                                 bno08x::ARVRStabilizedRotationVector,
+                                 bno08x::StabilityClassifier,
+                                 bno08x::StabilityDetector>;
+    friend ReportDispatcher;
+    friend bench::DriverBench;
+
+    struct Command {
+        enum class Type : uint8_t {
+            Reset,
+            SetFeature,
+            WriteFrs,
+            EnableAdaptiveRate,
+            // Applies the adaptive rate to the rotation vector, issued by the
+            // service task itself without a completion slot
+            ApplyRate,
+            Suspend,
+            Resume,
+        } type = Type::Reset;
+
+        uint8_t slot = NO_SLOT;
+        TickType_t timeout = 0;
+
+        // Arguments, only the ones of the command type are used
+        bno08x::SetFeatureCommand feature{};
+        // Owner of a rotation vector claim
+        Consumer consumer = Consumer::Default;
+        bno08x::FrsRecord record{};
+        bno08x::AdaptiveRate::Config rate{};
+        const Snapshot* snapshot = nullptr;
+
+        // Progress of multi step commands, owned by the service task
+        bool writing = false;
+        uint16_t offset = 0;
+    };
+
+    enum class Progress { Pending, Done, Failed };
+
+    struct CompletionSlot {
+        enum State : uint8_t { Free, Pending, Done, Abandoned };
+
+        std::atomic<uint8_t> state{Free};
+        bool success = false;
+        SemaphoreHandle_t done = nullptr;
+        StaticSemaphore_t done_buffer;
+    };
+
+    Future submit(Command command);
+    void complete(uint8_t slot, bool success);
+
     void service_func();
+    void update_rate(bno08x::AdaptiveRate::Change change);
+
+    Progress run_command(Command& command);
+    Progress on_response(Command& command);
+    Progress on_frs_response(Command& command);
+    Progress resume_next(Command& command);
+    // Commands wait for the answer to what they sent, unless it failed
+    static Progress expect_response(bool sent);
+    // Forgets everything about the device, which starts over
+    void reset_state();
+
+    // Rotation vector request that satisfies every claim
+    bno08x::SetFeatureCommand claimed_arvr() const;
+    // Records the feature for snapshots, then sends it with the adaptive
+    // rate applied
+    bool send_feature(bno08x::SetFeatureCommand feature);
+    void remember_feature(const bno08x::SetFeatureCommand& feature);
+
+    template <typename Message>
+    bool send(uint8_t chan, Message message);
+    template <typename Message>
+    bool send_control(Message message);
 
     void handle_generic();
 
-    const char* device_error_to_str(uint8_t code);
+    void on_report(const bno08x::BaseTimestampReference& report);
+    void on_report(const bno08x::RebaseTimestampReference& report);
+    void on_report(const bno08x::ARVRStabilizedRotationVector& report);
+    void on_report(const bno08x::GyroIntegratedRotationVector& report);
+    void on_report(const bno08x::StabilityClassifier& report);
+    void on_report(const bno08x::StabilityDetector& report);
 
-    bool recv(TickType_t timeout, bool acquire_bus);
+    const char* device_error_to_str(uint8_t code);
 
-    void acquire_bus();
-    void release_bus();
+    bool recv(TickType_t timeout);
+    void track_seq_num(bno08x::Header header);
 
     bool send_raw(std::span<const uint8_t> buf);
-    bool recv_raw(std::span<uint8_t> buf, TickType_t timeout, bool acquire_bus);
-    bool wait_for_irq(TickType_t timeout, bool acquire_bus);
+    bool recv_raw(std::span<uint8_t> buf, TickType_t timeout);
+    bool receive(std::span<uint8_t> buf);
+    bool irq_asserted() const;
+    void arm_irq();
+    bool wait_for_irq(TickType_t timeout);
+    void capture_read(bool ok, std::span<const uint8_t> buf);
+
+    void begin_transfer();
+    bool wait_for_transfer();
+    void end_transfer();
+    void recover_bus();
 
     static void on_irq(void* that);
+    static bool on_transfer_done(i2c_master_dev_handle_t dev,
+                                 const i2c_master_event_data_t* data,
+                                 void* that);
 
     static constexpr uint8_t ADDRESS = 0x4a;
-    static constexpr uint8_t CHANNEL_NUM = 6;
+    // Cargos are kept in the driver, the stack only holds the call chain
+    // from the service loop down to the I2C driver and the logs
+    static constexpr uint32_t SERVICE_STACK_SIZE = 6 * 1024;
+    static constexpr uint8_t CHANNEL_NUM = bno08x::channels::COUNT;
+
+    // Generous upper bound for the longest transfer at the slowest speed
+    static constexpr int TRANSFER_TIMEOUT_MS = 200;
+    // How long to wait for the rest of a fragmented cargo
+    static constexpr TickType_t RECV_TIMEOUT = pdMS_TO_TICKS(100);
+    // How long to wait for the device to answer a command
+    static constexpr TickType_t RESET_TIMEOUT = pdMS_TO_TICKS(2000);
+    static constexpr TickType_t COMMAND_TIMEOUT = pdMS_TO_TICKS(500);
+    static constexpr uint32_t RESET_PULSE_US = 1000;
+    // Task notification bits used to wake up the service task
+    static constexpr uint32_t TRANSFER_NOTIFY = 1 << 0;
+    static constexpr uint32_t IRQ_NOTIFY = 1 << 1;
+    static constexpr uint32_t COMMAND_NOTIFY = 1 << 2;
+
+    static constexpr size_t MAX_LISTENERS = 4;
+
+    static constexpr size_t COMMAND_QUEUE_LEN = 8;
+    static constexpr size_t COMPLETION_SLOTS = 4;
+    // Slot of the commands nobody waits on
+    static constexpr uint8_t NO_SLOT = 0xff;
+
+    // Minimum interval between two stability detector reports, they are only
+    // sent on change
+    static constexpr uint32_t STABILITY_DETECTOR_INTERVAL = 10'000;
 
     bool is_init = false;
+    i2c_master_bus_handle_t bus = nullptr;
     i2c_master_dev_handle_t dev_handle = nullptr;
     gpio_num_t bootn = GPIO_NUM_NC;
     gpio_num_t intr = GPIO_NUM_NC;
     gpio_num_t reset = GPIO_NUM_NC;
+    // Stands in for the device when replaying a capture
+    bno08x::Replay* replay = nullptr;
+    CaptureSink capture;
+
+    QueueHandle_t commands = nullptr;
+    StaticQueue_t commands_buffer;
+    std::array<uint8_t, COMMAND_QUEUE_LEN * sizeof(Command)> commands_storage;
+
+    std::array<CompletionSlot, COMPLETION_SLOTS> completions;
 
-    static constexpr EventBits_t IRQ_EV = 1 << 0;
-    static constexpr EventBits_t FREE_EV = 1 << 1;
-    EventGroupHandle_t events = nullptr;
+    // Time of the last interrupt, as captured by the ISR
+    volatile int64_t irq_time = 0;
+    // Time and trace stamp of the interrupt that signaled the cargo being
+    // read, they only differ when replaying
+    int64_t irq_in_time = 0;
+    uint32_t irq_in_stamp = 0;
 
-    Tasklet service;
+    volatile i2c_master_event_t transfer_event = I2C_EVENT_DONE;
+    // Keeps the CPU at full speed and out of light sleep during transfers,
+    // the chip sleeps between interrupts otherwise
+    power::Lock transfer_lock;
+
+    StaticTasklet<SERVICE_STACK_SIZE> service;
 
     struct ChannelInfo {
         uint8_t seq_num_in = 0;
@@ -63,6 +364,59 @@ private:
 
     bno08x::Header header_in;
     std::array<uint8_t, 1024> cargo_in;
+    // Host time and trace stamp of the interrupt that announced the cargo
+    int64_t cargo_in_time = 0;
+    uint32_t cargo_in_stamp = 0;
+    // Size of the first read of the next cargo
+    size_t recv_hint = bno08x::Header::SIZE;
+    // Converts the report delays of the cargo being handled to host time
+    bno08x::Timebase timebase;
+    // Smooth the timestamps of every sample stream
+    bno08x::StreamClock arvr_clock;
+    bno08x::StreamClock girv_clock;
+
+    // Last drift measurement, published for other tasks
+    static constexpr int32_t UNKNOWN_DRIFT = INT32_MIN;
+    std::atomic<int32_t> drift_ppm{UNKNOWN_DRIFT};
+
+    // Rotation vector intervals last requested, merged from the claims. The
+    // adaptive rate applies on top of them.
+    bno08x::SetFeatureCommand arvr_request{
+        .feature_report_id = bno08x::report_id::ARVR_STABILIZED_ROTATION_VECTOR,
+        .wake_up_enable = false,
+        .always_on_enable = false,
+        .report_interval = 0,
+        .batch_interval = 0,
+        .config_word = 0};
+    std::optional<bno08x::AdaptiveRate> adaptive;
+    // Set when the adaptive rate changed and has to be sent to the device
+    bool rate_dirty = false;
+
+    // Configuration requested since the last reset, and what it was when the
+    // device was last suspended
+    Snapshot state{};
+    Snapshot suspended{};
+    // Set while the device sleeps, it was suspended without losing track of
+    // it
+    bool is_suspended = false;
+
+    // FRS record being read back by a WriteFrs command
+    bno08x::FrsRecord frs_in;
+
+    // Last rotation vector accuracy, reused for gyro integrated samples
+    int16_t last_accuracy = 0;
+    bno08x::SensorReportCommon::Status last_status =
+        bno08x::SensorReportCommon::Status::Unreliable;
+
+    Samples sample_ring;
+
+    struct Listener {
+        TaskHandle_t task;
+        uint32_t bits;
+    };
+
+    std::array<Listener, MAX_LISTENERS> listeners;
+    std::atomic<size_t> listener_count{0};
 };
 
 }  // namespace euler
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "Bno08xProto.hpp"
+
+// Binary capture of the SHTP traffic between the driver and the device, for
+// reproducing field issues and profiling the pipeline on real traffic. This
+// header has no platform dependencies, captures are replayed on the host too.
+//
+// A capture starts with "SHTP" and a version byte, padded to 8 bytes, then
+// holds one record per transfer, little endian:
+//   u8  type
+//   u16 length of the data
+//   u32 time since the previous record, microseconds
+//   data
+// Times are esp_timer times: reads are stamped with the interrupt that
+// announced them, which is what the driver timestamps samples with, writes and
+// errors with the time they happened. Reads only keep the bytes covered by
+// their SHTP header, the rest of a speculative read is padding.
+//
+// Record types start at one, so a capture ends at the first zero or erased
+// (0xff) byte where a record is expected.
+namespace euler::bno08x {
+
+static constexpr std::array<uint8_t, 8> CAPTURE_MAGIC = {'S', 'H', 'T', 'P',
+                                                         1,   0,   0,   0};
+static constexpr size_t CAPTURE_RECORD_HEADER_SIZE = 7;
+
+struct CaptureRecord {
+    enum class Type : uint8_t {
+        // Transfer from the device
+        Read = 1,
+        // Transfer to the device
+        Write = 2,
+        // Read that failed on the bus, without data
+        Error = 3,
+        // Records the recorder had no room for, the data is their u32 count
+        Lost = 4,
+    };
+
+    Type type;
+    int64_t time;
+    std::span<const uint8_t> data;
+};
+
+// Encodes records, the caller stores CAPTURE_MAGIC first and then every
+// header followed by its data
+class CaptureWriter {
+public:
+    std::array<uint8_t, CAPTURE_RECORD_HEADER_SIZE> header(
+        const CaptureRecord& record) {
+        // Records are in order, a clock going backwards would be a bug
+        uint32_t dt = record.time > last_time ? record.time - last_time : 0;
+        last_time = record.time;
+
+        std::array<uint8_t, CAPTURE_RECORD_HEADER_SIZE> buf;
+        buf[0] = uint8_t(record.type);
+        write_u16(buf, 1, record.data.size());
+        write_u32(buf, 3, dt);
+        return buf;
+    }
+
+private:
+    int64_t last_time = 0;
+};
+
+class CaptureReader {
+public:
+    explicit CaptureReader(std::span<const uint8_t> buf) : buf{buf} {}
+
+    // True if the buffer starts with a capture this reader understands
+    bool valid() const {
+        return buf.size() >= CAPTURE_MAGIC.size() &&
+               std::equal(CAPTURE_MAGIC.begin(), CAPTURE_MAGIC.end(),
+                          buf.begin());
+    }
+
+    // Decodes the next record, its data points into the capture. Returns
+    // false at the end of the capture or if the last record is truncated.
+    bool next(CaptureRecord& record) {
+        if (off == 0) {
+            if (!valid()) return false;
+            off = CAPTURE_MAGIC.size();
+        }
+
+        if (off + CAPTURE_RECORD_HEADER_SIZE > buf.size()) return false;
+
+        uint8_t type = buf[off];
+        if (type < uint8_t(CaptureRecord::Type::Read) ||
+            type > uint8_t(CaptureRecord::Type::Lost))
+            return false;
+
+        size_t len = read_u16(buf, off + 1);
+        size_t start = off + CAPTURE_RECORD_HEADER_SIZE;
+        if (start + len > buf.size()) return false;
+
+        time += read_u32(buf, off + 3);
+        record = {.type = CaptureRecord::Type(type),
+                  .time = time,
+                  .data = buf.subspan(start, len)};
+        off = start + len;
+        return true;
+    }
+
+private:
+    std::span<const uint8_t> buf;
+    size_t off = 0;
+    int64_t time = 0;
+};
+
+}  // namespace euler::bno08x
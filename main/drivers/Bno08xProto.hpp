@@ -1,5 +1,8 @@
 #pragma once
 
+#include <utils/Fixed.hpp>
+
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -7,13 +10,13 @@
 
 namespace euler::bno08x {
 
-static inline void write_u16(std::span<uint8_t> buf, size_t off,
+static constexpr void write_u16(std::span<uint8_t> buf, size_t off,
                              uint16_t value) {
     buf[off + 0] = uint8_t(value);
     buf[off + 1] = uint8_t(value >> 8);
 }
 
-static inline void write_u32(std::span<uint8_t> buf, size_t off,
+static constexpr void write_u32(std::span<uint8_t> buf, size_t off,
                              uint32_t value) {
     buf[off + 0] = uint8_t(value);
     buf[off + 1] = uint8_t(value >> 8);
@@ -21,29 +24,29 @@ static inline void write_u32(std::span<uint8_t> buf, size_t off,
     buf[off + 3] = uint8_t(value >> 24);
 }
 
-static inline uint16_t read_u16(std::span<const uint8_t> buf, size_t off) {
+static constexpr uint16_t read_u16(std::span<const uint8_t> buf, size_t off) {
     return uint16_t(buf[off + 0] | (buf[off + 1] << 8));
 }
 
-static inline int16_t read_i16(std::span<const uint8_t> buf, size_t off) {
+static constexpr int16_t read_i16(std::span<const uint8_t> buf, size_t off) {
     return static_cast<int16_t>(read_u16(buf, off));
 }
 
-static inline float read_f16(std::span<const uint8_t> buf, size_t off, int q) {
-    return float(read_i16(buf, off) / float(1 << q));
-}
-
-static inline uint32_t read_u32(std::span<const uint8_t> buf, size_t off) {
+static constexpr uint32_t read_u32(std::span<const uint8_t> buf, size_t off) {
     return uint32_t(buf[off + 0] | (buf[off + 1] << 8) | (buf[off + 2] << 16) |
                     (buf[off + 3] << 24));
 }
 
-static inline int32_t read_i32(std::span<const uint8_t> buf, size_t off) {
+static constexpr int32_t read_i32(std::span<const uint8_t> buf, size_t off) {
     return static_cast<int32_t>(read_u32(buf, off));
 }
 
-static inline float read_f32(std::span<const uint8_t> buf, size_t off, int q) {
-    return float(read_i32(buf, off) / float(1 << q));
+// Fixed point values are kept as is, see utils/Fixed.hpp
+static constexpr Quat14 read_quat14(std::span<const uint8_t> buf, size_t off) {
+    return {.x = read_i16(buf, off + 0),
+            .y = read_i16(buf, off + 2),
+            .z = read_i16(buf, off + 4),
+            .w = read_i16(buf, off + 6)};
 }
 
 struct Header {
@@ -52,6 +55,8 @@ struct Header {
     uint8_t seq;
 
     static constexpr size_t SIZE = 4;
+    // Set in len when the transfer continues a previous cargo
+    static constexpr uint16_t CONTINUATION = 0x8000;
 
     static constexpr void write(Header value, std::span<uint8_t> buf) {
         write_u16(buf, 0, value.len);
@@ -71,8 +76,18 @@ static constexpr uint8_t SH2_CONTROL = 2;
 static constexpr uint8_t INPUT_SENSOR_REPORTS = 3;
 static constexpr uint8_t WAKE_INPUT_SENSOR_REPORTS = 4;
 static constexpr uint8_t GYRO_ROTATION_VECTOR = 5;
+static constexpr uint8_t COUNT = 6;
 }  // namespace channels
 
+// Commands written to the executable channel, only a reset is answered, with
+// a "reset complete" message
+namespace executable {
+static constexpr uint8_t RESET = 1;
+static constexpr uint8_t ON = 2;
+static constexpr uint8_t SLEEP = 3;
+static constexpr uint8_t RESET_COMPLETE = 1;
+}  // namespace executable
+
 namespace report_id {
 static constexpr uint8_t GET_FEATURE_REQUEST = 0xfe;
 static constexpr uint8_t SET_FEATURE_COMMAND = 0xfd;
@@ -102,7 +117,7 @@ static constexpr uint8_t AMBIENT_LIGHT = 0x0b;
 static constexpr uint8_t HUMIDITY = 0x0c;
 static constexpr uint8_t PROXIMITY = 0x0d;
 static constexpr uint8_t TEMPERATURE = 0x0e;
-static constexpr uint8_t UNCALIBRATED_MAGNETIC_FIELD = 0x0e;
+static constexpr uint8_t UNCALIBRATED_MAGNETIC_FIELD = 0x0f;
 static constexpr uint8_t TAP_DETECTOR = 0x10;
 static constexpr uint8_t STEP_COUNTER = 0x11;
 static constexpr uint8_t SIGNIFICANT_MOTION = 0x12;
@@ -124,8 +139,58 @@ static constexpr uint8_t CIRCLE_DETECTOR = 0x22;
 static constexpr uint8_t HEART_RATE_MONITOR = 0x23;
 static constexpr uint8_t ARVR_STABILIZED_ROTATION_VECTOR = 0x28;
 static constexpr uint8_t ARVR_STABILIZED_GAME_ROTATION_VECTOR = 0x29;
+static constexpr uint8_t GYRO_INTEGRATED_ROTATION_VECTOR = 0x2a;
 }  // namespace report_id
 
+namespace frs_type {
+static constexpr uint16_t GYRO_INTEGRATED_RV_CONFIG = 0xa1a2;
+}  // namespace frs_type
+
+// Size of every known input report, including the report id, indexed by report
+// id. Unknown reports have a size of 0.
+static constexpr std::array<uint8_t, 256> INPUT_REPORT_SIZES = [] {
+    std::array<uint8_t, 256> sizes{};
+    sizes[report_id::BASE_TIMESTAMP] = 5;
+    sizes[report_id::TIMESTAMP_REBASE] = 5;
+    sizes[report_id::ACCELEROMETER] = 10;
+    sizes[report_id::GYROSCOPE] = 10;
+    sizes[report_id::MAGNETIC_FIELD] = 10;
+    sizes[report_id::LINEAR_ACCELERATION] = 10;
+    sizes[report_id::ROTATION_VECTOR] = 14;
+    sizes[report_id::GRAVITY] = 10;
+    sizes[report_id::UNCALIBRATED_GYROSCOPE] = 16;
+    sizes[report_id::GAME_ROTATION_VECTOR] = 12;
+    sizes[report_id::GEOMAGNETIC_ROTATION_VECTOR] = 14;
+    sizes[report_id::PRESSURE] = 8;
+    sizes[report_id::AMBIENT_LIGHT] = 8;
+    sizes[report_id::HUMIDITY] = 6;
+    sizes[report_id::PROXIMITY] = 6;
+    sizes[report_id::TEMPERATURE] = 6;
+    sizes[report_id::UNCALIBRATED_MAGNETIC_FIELD] = 16;
+    sizes[report_id::TAP_DETECTOR] = 5;
+    sizes[report_id::STEP_COUNTER] = 12;
+    sizes[report_id::SIGNIFICANT_MOTION] = 6;
+    sizes[report_id::STABILITY_CLASSIFIER] = 6;
+    sizes[report_id::RAW_ACCELEROMETER] = 16;
+    sizes[report_id::RAW_GYROSCOPE] = 16;
+    sizes[report_id::RAW_MAGNETOMETER] = 16;
+    sizes[report_id::STEP_DETECTOR] = 8;
+    sizes[report_id::SHAKE_DETECTOR] = 6;
+    sizes[report_id::FLIP_DETECTOR] = 6;
+    sizes[report_id::PICKUP_DETECTOR] = 6;
+    sizes[report_id::STABILITY_DETECTOR] = 6;
+    sizes[report_id::PERSONAL_ACTIVITY_DETECTOR] = 16;
+    sizes[report_id::SLEEP_DETECTOR] = 6;
+    sizes[report_id::TILT_DETECTOR] = 6;
+    sizes[report_id::POCKET_DETECTOR] = 6;
+    sizes[report_id::CIRCLE_DETECTOR] = 6;
+    sizes[report_id::HEART_RATE_MONITOR] = 6;
+    sizes[report_id::ARVR_STABILIZED_ROTATION_VECTOR] = 14;
+    sizes[report_id::ARVR_STABILIZED_GAME_ROTATION_VECTOR] = 12;
+    sizes[report_id::GYRO_INTEGRATED_ROTATION_VECTOR] = 14;
+    return sizes;
+}();
+
 struct SetFeatureCommand {
     // TODO: Unsupported
     // uint16_t change_sensitivity;
@@ -159,9 +224,181 @@ struct SetFeatureCommand {
     }
 };
 
+// Command to the device itself rather than to the sensor hub, see the
+// executable namespace. Sensors stop while the device sleeps, which draws a
+// fraction of its running current and turns back on much faster than it
+// boots.
+struct ExecutableCommand {
+    uint8_t command;
+
+    static constexpr size_t SIZE = Header::SIZE + 1;
+
+    static constexpr void write(Header header, ExecutableCommand value,
+                                std::span<uint8_t> buf) {
+        Header::write(header, buf);
+        buf[4] = value.command;
+    }
+};
+
+// Contents of an FRS record, as a sequence of 32 bit words
+struct FrsRecord {
+    static constexpr size_t MAX_WORDS = 8;
+
+    uint16_t type;
+    uint8_t len;
+    std::array<uint32_t, MAX_WORDS> words;
+};
+
+struct FrsReadRequest {
+    // Offset of the first word to read
+    uint16_t offset;
+    uint16_t type;
+    // Number of words to read, 0 to read the whole record
+    uint16_t block_size;
+
+    static constexpr size_t SIZE = Header::SIZE + 8;
+
+    static constexpr void write(Header header, FrsReadRequest value,
+                                std::span<uint8_t> buf) {
+        Header::write(header, buf);
+        buf[4] = report_id::FRS_READ_REQUEST;
+        buf[5] = 0;
+        write_u16(buf, 6, value.offset);
+        write_u16(buf, 8, value.type);
+        write_u16(buf, 10, value.block_size);
+    }
+};
+
+struct FrsReadResponse {
+    // Number of valid words in data
+    uint8_t len;
+    uint8_t status;
+    // Offset of data[0] in the record
+    uint16_t offset;
+    uint32_t data[2];
+    uint16_t type;
+
+    static constexpr uint8_t NO_ERROR = 0;
+    static constexpr uint8_t UNRECOGNIZED_TYPE = 1;
+    static constexpr uint8_t BUSY = 2;
+    static constexpr uint8_t READ_COMPLETED = 3;
+    static constexpr uint8_t OFFSET_OUT_OF_RANGE = 4;
+    static constexpr uint8_t RECORD_EMPTY = 5;
+    static constexpr uint8_t BLOCK_COMPLETED = 6;
+    static constexpr uint8_t BLOCK_AND_RECORD_COMPLETED = 7;
+    static constexpr uint8_t DEVICE_ERROR = 8;
+
+    static constexpr size_t SIZE = 16;
+
+    static constexpr FrsReadResponse read(std::span<const uint8_t> buf) {
+        assert(buf[0] == report_id::FRS_REQ_RESPONSE);
+        return {.len = uint8_t(buf[1] >> 4),
+                .status = uint8_t(buf[1] & 0x0f),
+                .offset = read_u16(buf, 2),
+                .data = {read_u32(buf, 4), read_u32(buf, 8)},
+                .type = read_u16(buf, 12)};
+    }
+};
+
+struct FrsWriteRequest {
+    // Length of the record in words
+    uint16_t len;
+    uint16_t type;
+
+    static constexpr size_t SIZE = Header::SIZE + 6;
+
+    static constexpr void write(Header header, FrsWriteRequest value,
+                                std::span<uint8_t> buf) {
+        Header::write(header, buf);
+        buf[4] = report_id::FRS_WRITE_REQUEST;
+        buf[5] = 0;
+        write_u16(buf, 6, value.len);
+        write_u16(buf, 8, value.type);
+    }
+};
+
+struct FrsWriteData {
+    // Offset of data[0] in the record
+    uint16_t offset;
+    uint32_t data[2];
+
+    static constexpr size_t SIZE = Header::SIZE + 12;
+
+    static constexpr void write(Header header, FrsWriteData value,
+                                std::span<uint8_t> buf) {
+        Header::write(header, buf);
+        buf[4] = report_id::FRS_WRITE_DATA;
+        buf[5] = 0;
+        write_u16(buf, 6, value.offset);
+        write_u32(buf, 8, value.data[0]);
+        write_u32(buf, 12, value.data[1]);
+    }
+};
+
+struct FrsWriteResponse {
+    uint8_t status;
+    // Offset of the last word received
+    uint16_t offset;
+
+    static constexpr uint8_t WORDS_RECEIVED = 0;
+    static constexpr uint8_t UNRECOGNIZED_TYPE = 1;
+    static constexpr uint8_t BUSY = 2;
+    static constexpr uint8_t WRITE_COMPLETED = 3;
+    static constexpr uint8_t WRITE_READY = 4;
+    static constexpr uint8_t WRITE_FAILED = 5;
+    static constexpr uint8_t NOT_IN_WRITE_MODE = 6;
+    static constexpr uint8_t INVALID_LENGTH = 7;
+    static constexpr uint8_t RECORD_VALID = 8;
+    static constexpr uint8_t RECORD_INVALID = 9;
+    static constexpr uint8_t DEVICE_ERROR = 10;
+    static constexpr uint8_t READ_ONLY = 11;
+
+    static constexpr size_t SIZE = 4;
+
+    static constexpr FrsWriteResponse read(std::span<const uint8_t> buf) {
+        assert(buf[0] == report_id::FRS_WRITE_RESPONSE);
+        return {.status = buf[1], .offset = read_u16(buf, 2)};
+    }
+};
+
+// Configuration of the gyro integrated rotation vector, stored in FRS
+struct GyroIntegratedRVConfig {
+    // Sensor the output is corrected against, either ROTATION_VECTOR_REFERENCE
+    // or GAME_ROTATION_VECTOR_REFERENCE
+    uint16_t reference;
+    // Interval at which the output is synchronized with the reference, in
+    // microseconds
+    uint32_t sync_interval;
+    // Maximum error before correcting towards the reference, in radians
+    float max_error;
+    // How far ahead the output is predicted, in seconds
+    float prediction;
+    // Prediction filter coefficients
+    float alpha, beta, gamma;
+
+    static constexpr uint16_t ROTATION_VECTOR_REFERENCE = 0x0204;
+    static constexpr uint16_t GAME_ROTATION_VECTOR_REFERENCE = 0x0207;
+
+    static constexpr FrsRecord to_record(GyroIntegratedRVConfig value) {
+        return {.type = frs_type::GYRO_INTEGRATED_RV_CONFIG,
+                .len = 7,
+                .words = {value.reference, value.sync_interval,
+                          to_fixed(value.max_error, 29),
+                          to_fixed(value.prediction, 10),
+                          to_fixed(value.alpha, 20), to_fixed(value.beta, 20),
+                          to_fixed(value.gamma, 20)}};
+    }
+
+private:
+    static constexpr uint32_t to_fixed(float value, int q) {
+        return uint32_t(int32_t(value * float(1 << q)));
+    }
+};
+
 struct BaseTimestampReference {
     int32_t base_delta;
 
+    static constexpr uint8_t ID = report_id::BASE_TIMESTAMP;
     static constexpr size_t SIZE = 5;
 
     static constexpr BaseTimestampReference read(std::span<const uint8_t> buf) {
@@ -173,6 +410,7 @@ struct BaseTimestampReference {
 struct RebaseTimestampReference {
     int32_t rebase_delta;
 
+    static constexpr uint8_t ID = report_id::TIMESTAMP_REBASE;
     static constexpr size_t SIZE = 5;
 
     static constexpr RebaseTimestampReference read(
@@ -219,9 +457,11 @@ struct SensorReportCommon {
 
 struct ARVRStabilizedRotationVector {
     SensorReportCommon common;
-    float x, y, z, w;
-    float accuracy;
+    Quat14 rotation;
+    // Estimated heading accuracy in radians, Q12
+    int16_t accuracy;
 
+    static constexpr uint8_t ID = report_id::ARVR_STABILIZED_ROTATION_VECTOR;
     static constexpr size_t SIZE = SensorReportCommon::SIZE + 10;
 
     static constexpr ARVRStabilizedRotationVector read(
@@ -229,12 +469,125 @@ struct ARVRStabilizedRotationVector {
         assert(buf[0] == report_id::ARVR_STABILIZED_ROTATION_VECTOR);
 
         return {.common = SensorReportCommon::read(buf),
-                .x = read_f16(buf, 4, 14),
-                .y = read_f16(buf, 6, 14),
-                .z = read_f16(buf, 8, 14),
-                .w = read_f16(buf, 10, 14),
-                .accuracy = read_f16(buf, 12, 12)};
+                .rotation = read_quat14(buf, 4),
+                .accuracy = read_i16(buf, 12)};
+    }
+};
+
+// Periodic estimate of how much the device is moving
+struct StabilityClassifier {
+    SensorReportCommon common;
+    enum class Classification : uint8_t {
+        Unknown,
+        OnTable,
+        Stationary,
+        Stable,
+        Motion,
+    } classification;
+
+    static constexpr uint8_t ID = report_id::STABILITY_CLASSIFIER;
+    static constexpr size_t SIZE = SensorReportCommon::SIZE + 2;
+
+    static constexpr StabilityClassifier read(std::span<const uint8_t> buf) {
+        assert(buf[0] == report_id::STABILITY_CLASSIFIER);
+
+        // Values past the ones in the reference manual are reserved
+        return {.common = SensorReportCommon::read(buf),
+                .classification =
+                    buf[4] <= uint8_t(Classification::Motion)
+                        ? Classification(buf[4])
+                        : Classification::Unknown};
+    }
+};
+
+// Sent on change only, when the device enters or leaves a stable state
+struct StabilityDetector {
+    SensorReportCommon common;
+    uint16_t state;
+
+    static constexpr uint16_t ENTERED_STABLE = 1 << 0;
+    static constexpr uint16_t EXITED_STABLE = 1 << 1;
+
+    static constexpr uint8_t ID = report_id::STABILITY_DETECTOR;
+    static constexpr size_t SIZE = SensorReportCommon::SIZE + 2;
+
+    static constexpr StabilityDetector read(std::span<const uint8_t> buf) {
+        assert(buf[0] == report_id::STABILITY_DETECTOR);
+
+        return {.common = SensorReportCommon::read(buf),
+                .state = read_u16(buf, 4)};
     }
 };
 
+// Report sent on the dedicated gyro integrated rotation vector channel. It has
+// no report id nor common header to keep latency to a minimum.
+struct GyroIntegratedRotationVector {
+    Quat14 rotation;
+    // Angular velocity in radians per second, Q10
+    std::array<int16_t, 3> angular_velocity;
+
+    static constexpr size_t SIZE = 14;
+
+    static constexpr GyroIntegratedRotationVector read(
+        std::span<const uint8_t> buf) {
+        return {.rotation = read_quat14(buf, 0),
+                .angular_velocity = {read_i16(buf, 8), read_i16(buf, 10),
+                                     read_i16(buf, 12)}};
+    }
+};
+
+// Compile time dispatcher for the input reports found in a sensor report
+// cargo. Every type in Reports must provide an ID, a SIZE and a read()
+// function, Handler must provide an on_report() overload for each of them.
+// Known reports without a parser are skipped using INPUT_REPORT_SIZES, so
+// adding support for a new report only requires a new struct and overload.
+template <typename Handler, typename... Reports>
+class ReportDispatcher {
+public:
+    static_assert(((INPUT_REPORT_SIZES[Reports::ID] == Reports::SIZE) && ...),
+                  "Report size does not match INPUT_REPORT_SIZES");
+
+    // Walk a sequence of input reports, returns the offset at which parsing
+    // stopped. This is equal to the buffer size if every report was consumed,
+    // otherwise it points to an unknown or truncated report.
+    static size_t dispatch(Handler& handler, std::span<const uint8_t> buf) {
+        size_t off = 0;
+        while (off < buf.size()) {
+            const Entry& entry = TABLE[buf[off]];
+            if (entry.size == 0 || buf.size() - off < entry.size) break;
+
+            if (entry.parse != nullptr)
+                entry.parse(handler, buf.subspan(off, entry.size));
+
+            off += entry.size;
+        }
+
+        return off;
+    }
+
+    static constexpr size_t size_of(uint8_t id) { return TABLE[id].size; }
+
+private:
+    struct Entry {
+        uint8_t size;
+        void (*parse)(Handler& handler, std::span<const uint8_t> buf);
+    };
+
+    template <typename Report>
+    static void parse(Handler& handler, std::span<const uint8_t> buf) {
+        handler.on_report(Report::read(buf));
+    }
+
+    static constexpr std::array<Entry, 256> TABLE = [] {
+        std::array<Entry, 256> table{};
+        for (size_t id = 0; id < table.size(); id++)
+            table[id] = {.size = INPUT_REPORT_SIZES[id], .parse = nullptr};
+
+        ((table[Reports::ID] = {.size = Reports::SIZE,
+                                .parse = &parse<Reports>}),
+         ...);
+        return table;
+    }();
+};
+
 }  // namespace euler::bno08x
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "Bno08xRate.hpp"
+
+#include <algorithm>
+
+using namespace euler::bno08x;
+
+AdaptiveRate::Change AdaptiveRate::on_report(
+    const StabilityClassifier &report, int64_t time) {
+    using Classification = StabilityClassifier::Classification;
+
+    switch (report.classification) {
+        case Classification::OnTable:
+        case Classification::Stationary:
+        case Classification::Stable:
+            return on_stable(time);
+
+        case Classification::Unknown:
+        case Classification::Motion:
+            // Not knowing is treated as moving, latency matters more
+            break;
+    }
+
+    return on_motion();
+}
+
+AdaptiveRate::Change AdaptiveRate::on_report(const StabilityDetector &report,
+                                             int64_t time) {
+    // Both bits can be set if the state changed twice since the last report,
+    // the last one is unknown, so assume motion
+    if (report.state & StabilityDetector::EXITED_STABLE) return on_motion();
+    if (report.state & StabilityDetector::ENTERED_STABLE)
+        return on_stable(time);
+    return Change::None;
+}
+
+AdaptiveRate::Change AdaptiveRate::poll(int64_t time) {
+    if (slow || !stable || time - stable_since < config.settle_time)
+        return Change::None;
+
+    slow = true;
+    return Change::SlowDown;
+}
+
+SetFeatureCommand AdaptiveRate::adapt(SetFeatureCommand request) const {
+    // Turning the report off always goes through
+    if (!slow || request.report_interval == 0) return request;
+
+    request.report_interval =
+        std::max(request.report_interval, config.still_interval);
+    request.batch_interval =
+        std::max(request.batch_interval, config.still_batch_interval);
+    return request;
+}
+
+AdaptiveRate::Change AdaptiveRate::on_motion() {
+    stable = false;
+    if (!slow) return Change::None;
+
+    slow = false;
+    return Change::SpeedUp;
+}
+
+AdaptiveRate::Change AdaptiveRate::on_stable(int64_t time) {
+    // Periodic classifier reports must not push the deadline back
+    if (!stable) {
+        stable = true;
+        stable_since = time;
+    }
+
+    return poll(time);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Bno08xProto.hpp"
+
+namespace euler::bno08x {
+
+// Slows the rotation vector down while the head is still, following the
+// stability reports of the device. Motion speeds it back up at the first
+// report that shows it, while slowing down waits for the head to stay still
+// for a while, so that a pause in a movement doesn't make the rate flap.
+class AdaptiveRate {
+public:
+    struct Config {
+        // Rotation vector intervals while still, in microseconds. Requested
+        // intervals that are already longer are left alone.
+        uint32_t still_interval;
+        uint32_t still_batch_interval;
+        // How long the head has to stay still before slowing down
+        uint32_t settle_time;
+        // Interval of the stability classifier, zero to only follow the
+        // stability detector, which reports changes as they happen
+        uint32_t classifier_interval;
+    };
+
+    // What the rotation vector needs after an update
+    enum class Change { None, SlowDown, SpeedUp };
+
+    explicit AdaptiveRate(const Config& config) : config{config} {}
+
+    // Times are host times in microseconds
+    Change on_report(const StabilityClassifier& report, int64_t time);
+    Change on_report(const StabilityDetector& report, int64_t time);
+    // Slows down once the head has been still long enough, to be called as
+    // time passes
+    Change poll(int64_t time);
+
+    bool still() const { return slow; }
+
+    // Intervals to actually apply for a rotation vector request
+    SetFeatureCommand adapt(SetFeatureCommand request) const;
+
+private:
+    Change on_motion();
+    Change on_stable(int64_t time);
+
+    Config config;
+
+    bool slow = false;
+    // Whether the head is still, and since when
+    bool stable = false;
+    int64_t stable_since = 0;
+};
+
+}  // namespace euler::bno08x
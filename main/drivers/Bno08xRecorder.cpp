@@ -0,0 +1,186 @@
+#include "Bno08xRecorder.hpp"
+
+#include <esp_log.h>
+
+#include <algorithm>
+
+static const char *TAG = "Bno08xRecorder";
+
+using namespace euler::bno08x;
+
+Recorder::Recorder()
+    : queue{xStreamBufferCreateStatic(QUEUE_SIZE, 1, queue_storage.data(),
+                                      &queue_buffer)} {
+    assert(queue != nullptr);
+}
+
+bool Recorder::init_uart(uart_port_t port, gpio_num_t tx,
+                         uint32_t baud_rate) {
+    if (uart || partition != nullptr) return false;
+
+    uart_config_t config = {};
+    config.baud_rate = int(baud_rate);
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    config.source_clk = UART_SCLK_DEFAULT;
+
+    // The driver wants a receive buffer larger than the FIFO, even unused
+    esp_err_t err =
+        uart_driver_install(port, 2 * SOC_UART_FIFO_LEN, CHUNK_SIZE * 4, 0,
+                            nullptr, 0);
+    if (err == ESP_OK) err = uart_param_config(port, &config);
+    if (err == ESP_OK)
+        err = uart_set_pin(port, tx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE,
+                           UART_PIN_NO_CHANGE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up the UART with err: %d", err);
+        return false;
+    }
+
+    uart = port;
+    return start();
+}
+
+bool Recorder::init_partition(const char *label) {
+    if (uart || partition != nullptr) return false;
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == nullptr) {
+        ESP_LOGE(TAG, "No capture partition named %s", label);
+        return false;
+    }
+
+    return start();
+}
+
+bool Recorder::start() {
+    if (!write(CAPTURE_MAGIC)) return false;
+
+    ESP_LOGI(TAG, "Recording the SHTP traffic to %s",
+             uart ? "the UART" : partition->label);
+    return task.start("Bno08xRecorder", Priority::Background,
+                      [this]() { writer_func(); });
+}
+
+void Recorder::record(const CaptureRecord &record) {
+    size_t space = xStreamBufferSpacesAvailable(queue);
+
+    if (lost > 0) {
+        // Report the gap before anything else goes in
+        std::array<uint8_t, 4> count;
+        write_u32(count, 0, lost);
+        CaptureRecord gap{.type = CaptureRecord::Type::Lost,
+                          .time = record.time,
+                          .data = count};
+        if (space < CAPTURE_RECORD_HEADER_SIZE + count.size()) {
+            lost++;
+            return;
+        }
+
+        auto header = writer.header(gap);
+        xStreamBufferSend(queue, header.data(), header.size(), 0);
+        xStreamBufferSend(queue, count.data(), count.size(), 0);
+        space -= header.size() + count.size();
+        lost = 0;
+    }
+
+    if (space < CAPTURE_RECORD_HEADER_SIZE + record.data.size()) {
+        lost++;
+        return;
+    }
+
+    // Only this task writes to the queue, both parts fit
+    auto header = writer.header(record);
+    xStreamBufferSend(queue, header.data(), header.size(), 0);
+    xStreamBufferSend(queue, record.data.data(), record.data.size(), 0);
+}
+
+std::optional<std::span<const uint8_t>> Recorder::map_partition(
+    const char *label) {
+    const esp_partition_t *partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == nullptr) {
+        ESP_LOGE(TAG, "No capture partition named %s", label);
+        return std::nullopt;
+    }
+
+    // The mapping is never released, replays run until reboot
+    const void *data = nullptr;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size,
+                                       ESP_PARTITION_MMAP_DATA, &data, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map the capture partition with err: %d", err);
+        return std::nullopt;
+    }
+
+    return std::span{static_cast<const uint8_t *>(data), partition->size};
+}
+
+void Recorder::writer_func() {
+    std::array<uint8_t, CHUNK_SIZE> chunk;
+
+    while (1) {
+        size_t len = xStreamBufferReceive(queue, chunk.data(), chunk.size(),
+                                          portMAX_DELAY);
+        // Keep draining on failure, the driver must never see a full queue
+        // for long
+        write({chunk.data(), len});
+    }
+}
+
+bool Recorder::write(std::span<const uint8_t> buf) {
+    if (uart) {
+        int written = uart_write_bytes(*uart, buf.data(), buf.size());
+        if (written != int(buf.size())) {
+            ESP_LOGE(TAG, "Failed to write the capture to the UART");
+            return false;
+        }
+
+        return true;
+    }
+
+    return write_partition(buf);
+}
+
+bool Recorder::write_partition(std::span<const uint8_t> buf) {
+    if (full) return false;
+
+    if (offset + buf.size() > partition->size) {
+        ESP_LOGW(TAG, "Capture partition is full, recording stopped");
+        full = true;
+        return false;
+    }
+
+    // Erase just ahead of the writes, keeping at least one erased byte past
+    // them: it ends the capture wherever recording stops, even on a sector
+    // boundary where the next sector still holds an older capture
+    size_t end = std::min<size_t>(offset + buf.size() + 1, partition->size);
+    while (erased < end) {
+        esp_err_t err =
+            esp_partition_erase_range(partition, erased, partition->erase_size);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to erase the capture partition with err: %d",
+                     err);
+            full = true;
+            return false;
+        }
+
+        erased += partition->erase_size;
+    }
+
+    esp_err_t err = esp_partition_write(partition, offset, buf.data(),
+                                        buf.size());
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write the capture partition with err: %d",
+                 err);
+        full = true;
+        return false;
+    }
+
+    offset += buf.size();
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/stream_buffer.h>
+#include <utils/Tasklet.hpp>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "Bno08xCapture.hpp"
+
+namespace euler::bno08x {
+
+// Stores a capture of the driver traffic, see Bno08x::set_capture(). Records
+// are queued by the service task without blocking and written out by a task of
+// the recorder, either streamed over a UART or to a flash partition. Records
+// that don't fit in the queue are dropped and accounted for with a Lost
+// record, the replay shows them as a gap.
+class Recorder {
+public:
+    // Label of the flash partition captures are written to and replayed from
+    static constexpr const char* PARTITION = "capture";
+
+    Recorder();
+    Recorder(const Recorder&) = delete;
+    Recorder(Recorder&&) = delete;
+
+    // The port should not be the console one, the capture is binary
+    bool init_uart(uart_port_t port, gpio_num_t tx, uint32_t baud_rate);
+    // Overwrites the previous capture, recording stops when the partition is
+    // full. Flash writes stall the CPU, expect some extra latency.
+    bool init_partition(const char* label = PARTITION);
+
+    // Called from the driver service task
+    void record(const CaptureRecord& record);
+
+    // Maps the capture stored in a partition, for replaying it
+    static std::optional<std::span<const uint8_t>> map_partition(
+        const char* label = PARTITION);
+
+private:
+    static constexpr size_t QUEUE_SIZE = 8 * 1024;
+    // How much is handed to the sink at once
+    static constexpr size_t CHUNK_SIZE = 512;
+
+    bool start();
+    void writer_func();
+    bool write(std::span<const uint8_t> buf);
+    bool write_partition(std::span<const uint8_t> buf);
+
+    StreamBufferHandle_t queue = nullptr;
+    StaticStreamBuffer_t queue_buffer;
+    // Stream buffers keep one byte free
+    std::array<uint8_t, QUEUE_SIZE + 1> queue_storage;
+
+    CaptureWriter writer;
+    uint32_t lost = 0;
+
+    std::optional<uart_port_t> uart;
+    const esp_partition_t* partition = nullptr;
+    // Write position in the partition and end of its erased part
+    size_t offset = 0;
+    size_t erased = 0;
+    bool full = false;
+
+    StaticTasklet<4 * 1024> task;
+};
+
+}  // namespace euler::bno08x
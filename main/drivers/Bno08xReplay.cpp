@@ -0,0 +1,88 @@
+#include "Bno08xReplay.hpp"
+
+#include <esp_timer.h>
+#include <utils/Tasklet.hpp>
+
+#include <algorithm>
+
+using namespace euler::bno08x;
+
+Replay::Replay(std::span<const uint8_t> capture, uint32_t speed)
+    : reader{capture}, speed{speed} {
+    advance();
+}
+
+bool Replay::wait_for_read(TickType_t timeout, int64_t &irq_time) {
+    if (!next) return false;
+
+    if (speed > 0) {
+        int64_t now = esp_timer_get_time();
+        if (!start_time) {
+            start_time = now;
+            start_capture_time = next->time;
+        }
+
+        int64_t due =
+            *start_time + (next->time - start_capture_time) / int64_t(speed);
+        if (due > now) {
+            // Round up, waking up early would spin
+            TickType_t ticks = Tasklet::ticks_for(due - now);
+            if (ticks > timeout) {
+                vTaskDelay(timeout);
+                return false;
+            }
+
+            vTaskDelay(ticks);
+        }
+    }
+
+    irq_time = next->time;
+    return true;
+}
+
+bool Replay::read(std::span<uint8_t> buf) {
+    if (!next) return false;
+
+    bool ok = next->type == CaptureRecord::Type::Read;
+    if (ok) {
+        size_t len = std::min(buf.size(), next->data.size());
+        std::copy_n(next->data.begin(), len, buf.begin());
+        std::fill(buf.begin() + len, buf.end(), 0);
+        reads.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    advance();
+    return ok;
+}
+
+Replay::Stats Replay::stats() const {
+    return {.reads = reads.load(std::memory_order_relaxed),
+            .errors = errors.load(std::memory_order_relaxed),
+            .lost = lost.load(std::memory_order_relaxed)};
+}
+
+void Replay::advance() {
+    CaptureRecord record;
+    while (reader.next(record)) {
+        switch (record.type) {
+            case CaptureRecord::Type::Read:
+            case CaptureRecord::Type::Error:
+                next = record;
+                return;
+
+            case CaptureRecord::Type::Write:
+                break;
+
+            case CaptureRecord::Type::Lost:
+                if (record.data.size() >= 4)
+                    lost.fetch_add(read_u32(record.data, 0),
+                                   std::memory_order_relaxed);
+                break;
+        }
+    }
+
+    next.reset();
+    done.store(true, std::memory_order_release);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "Bno08xCapture.hpp"
+
+namespace euler::bno08x {
+
+// Plays a capture back to the driver in place of the device, see
+// Bno08x::init(Replay&). Reads are handed out in order with the interrupt
+// times they were recorded with, so the driver produces the same samples on
+// every run whatever the pacing. Writes from the driver are accepted and
+// dropped, the responses it expects are already in the capture.
+class Replay {
+public:
+    struct Stats {
+        uint32_t reads;
+        uint32_t errors;
+        // Records the recorder lost while capturing
+        uint32_t lost;
+    };
+
+    // Reads are delivered speed times faster than they were recorded, or as
+    // fast as the driver takes them if zero. The capture must outlive this.
+    explicit Replay(std::span<const uint8_t> capture, uint32_t speed = 1);
+    Replay(const Replay&) = delete;
+    Replay(Replay&&) = delete;
+
+    bool valid() const { return reader.valid(); }
+
+    // Only used by the driver service task
+    bool pending() const { return next.has_value(); }
+    // Waits for the next read to be due and returns its interrupt time, false
+    // on timeout or at the end of the capture
+    bool wait_for_read(TickType_t timeout, int64_t& irq_time);
+    // Hands out the next read, zero filled past the recorded bytes, false if
+    // it failed when it was recorded
+    bool read(std::span<uint8_t> buf);
+
+    // True once every read was handed out, safe to poll from any task
+    bool finished() const { return done.load(std::memory_order_acquire); }
+    Stats stats() const;
+
+private:
+    // Moves to the next read or failed read
+    void advance();
+
+    CaptureReader reader;
+    uint32_t speed;
+    std::optional<CaptureRecord> next;
+
+    // Host and capture times of the first read, the pacing reference
+    std::optional<int64_t> start_time;
+    int64_t start_capture_time = 0;
+
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> reads{0};
+    std::atomic<uint32_t> errors{0};
+    std::atomic<uint32_t> lost{0};
+};
+
+}  // namespace euler::bno08x
@@ -0,0 +1,103 @@
+#include "Bno08xTimebase.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace euler::bno08x;
+
+void StreamClock::reset() {
+    state = State::Unlocked;
+    host_period = 0;
+    outliers = 0;
+    sensor_period = 0;
+    sensor_periods = 0;
+}
+
+int64_t StreamClock::stamp(const Timebase &timebase, uint16_t delay) {
+    int64_t raw = timebase.host_time(delay);
+    int64_t sensor_offset = timebase.sensor_offset(delay);
+
+    // Reports in the same cargo are spaced on the sensor clock
+    if (state != State::Unlocked && timebase.cargo_index() == last_cargo &&
+        sensor_offset > last_sensor_offset) {
+        int64_t spacing = (sensor_offset - last_sensor_offset) << PERIOD_Q;
+        if (sensor_periods == 0) {
+            sensor_period = spacing;
+        } else {
+            sensor_period += (spacing - sensor_period) / SENSOR_PERIOD_DIV;
+        }
+
+        sensor_periods++;
+    }
+
+    last_cargo = timebase.cargo_index();
+    last_sensor_offset = sensor_offset;
+
+    switch (state) {
+        case State::Unlocked:
+            state = State::Acquiring;
+            estimate = raw << PERIOD_Q;
+            return raw;
+
+        case State::Acquiring:
+            // We need two samples to get a first period estimate
+            if (raw > (estimate >> PERIOD_Q)) {
+                host_period =
+                    std::max((raw << PERIOD_Q) - estimate, MIN_PERIOD);
+                average_period = host_period;
+                state = State::Locked;
+            }
+
+            return emit(raw << PERIOD_Q);
+
+        case State::Locked:
+            break;
+    }
+
+    // Predict where the sample should be, allowing for dropped samples
+    int64_t elapsed = (raw << PERIOD_Q) - estimate;
+    int64_t steps =
+        std::max<int64_t>(1, (elapsed + host_period / 2) / host_period);
+    int64_t predicted = estimate + host_period * steps;
+    int64_t error = (raw << PERIOD_Q) - predicted;
+
+    // Large errors mean the rate changed or the stream stalled, a few of them
+    // in a row make us start over. Until then they are left out of the
+    // periods, and the timestamps follow the prediction.
+    if (std::abs(error) * 4 > host_period) {
+        if (++outliers >= MAX_OUTLIERS) {
+            outliers = 0;
+            state = State::Acquiring;
+            return emit(raw << PERIOD_Q);
+        }
+
+        return emit(predicted);
+    }
+
+    outliers = 0;
+    host_period =
+        std::max(host_period + error / (steps * BETA_DIV), MIN_PERIOD);
+    // The period tracks the interrupt jitter too, drift needs a longer view
+    average_period += (host_period - average_period) / AVERAGE_DIV;
+    return emit(predicted + error / ALPHA_DIV);
+}
+
+int64_t StreamClock::emit(int64_t next) {
+    // Never go backwards, nor emit the same timestamp twice
+    estimate = std::max(next, estimate + (1 << PERIOD_Q));
+    return estimate >> PERIOD_Q;
+}
+
+std::optional<int64_t> StreamClock::period() const {
+    if (state != State::Locked) return std::nullopt;
+    return host_period >> PERIOD_Q;
+}
+
+std::optional<int32_t> StreamClock::drift_ppm() const {
+    if (state != State::Locked || sensor_periods < MIN_SENSOR_PERIODS ||
+        sensor_period <= 0)
+        return std::nullopt;
+
+    return int32_t((average_period - sensor_period) * 1'000'000 /
+                   sensor_period);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+namespace euler::bno08x {
+
+// Maps report delays to host time for the cargo being processed, following the
+// base and rebase timestamp references as described in the SH-2 reference
+// manual: t = t_irq + (reference_delta + delay) * 100us
+class Timebase {
+public:
+    // Every sensor cargo starts with a fresh reference
+    void begin_cargo(int64_t irq_time) {
+        anchor = irq_time;
+        delta = 0;
+        cargo++;
+    }
+
+    void on_base(int32_t base_delta) { delta = -base_delta; }
+    void on_rebase(int32_t rebase_delta) { delta += rebase_delta; }
+
+    // Offset of a report from the interrupt, measured on the sensor clock, in
+    // microseconds
+    int64_t sensor_offset(uint16_t delay) const {
+        return (int64_t(delta) + delay) * 100;
+    }
+
+    // Host time of a report, in microseconds
+    int64_t host_time(uint16_t delay) const {
+        return anchor + sensor_offset(delay);
+    }
+
+    // Identifies the current cargo
+    uint32_t cargo_index() const { return cargo; }
+
+private:
+    int64_t anchor = 0;
+    int32_t delta = 0;
+    uint32_t cargo = 0;
+};
+
+// Tracks a periodic sample stream and turns the raw per report host times into
+// monotonic, low jitter timestamps. The raw times carry the interrupt latency
+// of every cargo, an alpha-beta filter on the sample period smooths it out and
+// keeps an estimate of the period as seen by the host clock. Comparing it with
+// the spacing of reports inside a batch, which is measured on the sensor
+// clock, gives the drift between the two clocks.
+class StreamClock {
+public:
+    // Forget the stream history, to be used when the report rate changes
+    void reset();
+
+    // Timestamp of the next sample of the stream, in microseconds
+    int64_t stamp(const Timebase& timebase, uint16_t delay);
+
+    // Estimated sample period on the host clock, in microseconds
+    std::optional<int64_t> period() const;
+
+    // Drift of the sensor clock relative to the host clock, in parts per
+    // million. Only available once enough batched reports have been seen.
+    std::optional<int32_t> drift_ppm() const;
+
+private:
+    int64_t emit(int64_t next);
+
+    // Fractional bits of the fixed point periods
+    static constexpr int PERIOD_Q = 8;
+    // Filter gains, as divisors
+    static constexpr int64_t ALPHA_DIV = 8;
+    static constexpr int64_t BETA_DIV = 64;
+    static constexpr int64_t SENSOR_PERIOD_DIV = 64;
+    static constexpr int64_t AVERAGE_DIV = 256;
+    // Consecutive outliers after which the stream is acquired again
+    static constexpr uint32_t MAX_OUTLIERS = 4;
+    // Samples needed before the sensor period is trusted
+    static constexpr uint32_t MIN_SENSOR_PERIODS = 16;
+    // Shortest host period, the device reports at 10 kHz at most. It keeps
+    // the predictions from dividing by zero whatever the stream does.
+    static constexpr int64_t MIN_PERIOD = int64_t(100) << PERIOD_Q;
+
+    enum class State { Unlocked, Acquiring, Locked } state = State::Unlocked;
+
+    // Last emitted timestamp, fixed point like the periods
+    int64_t estimate = 0;
+    // Sample period on the host clock
+    int64_t host_period = 0;
+    int64_t average_period = 0;
+    uint32_t outliers = 0;
+
+    // Sample period on the sensor clock, from reports sharing a cargo
+    int64_t sensor_period = 0;
+    uint32_t sensor_periods = 0;
+    uint32_t last_cargo = 0;
+    int64_t last_sensor_offset = 0;
+};
+
+}  // namespace euler::bno08x
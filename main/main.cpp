@@ -1,9 +1,9 @@
 #include "Euler.hpp"
 
-#include <memory>
-
 extern "C" void app_main() {
-    std::unique_ptr<euler::Euler> euler = std::make_unique<euler::Euler>();
-    euler->init();
-    euler->main();
+    // Statically allocated like everything the firmware keeps, see
+    // CONFIG_EULER_STATIC_HEAP
+    static euler::Euler euler;
+    euler.init();
+    euler.main();
 }
\ No newline at end of file
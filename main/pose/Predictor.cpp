@@ -0,0 +1,74 @@
+#include "Predictor.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace euler;
+
+// One Q10 rad/s over one microsecond is this many Q14 radians, divided
+static constexpr int64_t Q10_US_TO_Q14 = 1'000'000 / (1 << 4);
+
+void Predictor::update(const Bno08x::Sample &sample) {
+    int64_t dt = sample.timestamp - last_timestamp;
+
+    if (sample.source == Bno08x::Sample::Source::GyroIntegratedRotationVector) {
+        // Measured by the sensor, nothing to estimate
+        omega = sample.angular_velocity;
+    } else if (has_last && dt > 0 && dt <= MAX_SAMPLE_GAP) {
+        // The body frame rotation between the two samples, for small angles
+        // its vector part is half the rotation vector
+        Quat14 delta =
+            Quat14::multiply(last_rotation.conjugate(), sample.rotation);
+        if (delta.w < 0) delta = delta.negated();
+
+        std::array<int16_t, 3> vec = {delta.x, delta.y, delta.z};
+        for (size_t i = 0; i < 3; i++) {
+            int64_t estimate = int64_t(vec[i]) * 2 * Q10_US_TO_Q14 / dt;
+            int32_t step = (int32_t(std::clamp<int64_t>(estimate, INT16_MIN,
+                                                        INT16_MAX)) -
+                            omega[i]) /
+                           SMOOTHING_DIV;
+            omega[i] = fixed::saturate(omega[i] + step);
+        }
+    } else {
+        // A gap in the stream, start over
+        omega = {};
+    }
+
+    has_last = true;
+    last_rotation = sample.rotation;
+    last_timestamp = sample.timestamp;
+}
+
+Quat14 Predictor::predict(int64_t target_time) const {
+    int64_t horizon = std::clamp<int64_t>(target_time - last_timestamp, 0,
+                                          max_horizon);
+    if (!has_last || horizon == 0) return last_rotation;
+
+    // Half the rotation over the horizon, in Q14 radians
+    std::array<int32_t, 3> half;
+    for (size_t i = 0; i < 3; i++)
+        half[i] = int32_t(int64_t(omega[i]) * horizon / (2 * Q10_US_TO_Q14));
+
+    // exp() of the half rotation, second order: the vector part stays, the
+    // scalar part is cos(angle / 2) ~ 1 - angle^2 / 8, normalized afterwards
+    int64_t half2 = int64_t(half[0]) * half[0] + int64_t(half[1]) * half[1] +
+                    int64_t(half[2]) * half[2];
+    int32_t w = std::max<int32_t>(
+        Quat14::ONE - int32_t((half2 >> Quat14::Q) / 2), 0);
+
+    // Keep the step within the range of the kernels, the normalization only
+    // cares about the direction
+    int32_t largest = std::max({std::abs(half[0]), std::abs(half[1]),
+                                std::abs(half[2]), std::abs(w)});
+    int32_t shift = 0;
+    while ((largest >> shift) > Quat14::ONE) shift++;
+
+    Quat14 step = Quat14::normalize({fixed::saturate(half[0] >> shift),
+                                     fixed::saturate(half[1] >> shift),
+                                     fixed::saturate(half[2] >> shift),
+                                     fixed::saturate(w >> shift)});
+
+    // The angular velocity is in the sensor frame, so it applies on the right
+    return Quat14::normalize(Quat14::multiply(last_rotation, step));
+}
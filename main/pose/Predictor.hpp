@@ -0,0 +1,45 @@
+#pragma once
+
+#include <drivers/Bno08x.hpp>
+#include <utils/Fixed.hpp>
+
+#include <array>
+#include <cstdint>
+
+namespace euler {
+
+// Extrapolates the orientation forward in time to hide the transport latency.
+//
+// Angular velocity comes straight from the samples when the gyro integrated
+// rotation vector is enabled, otherwise it is estimated from the rotation
+// between consecutive samples. Everything runs in fixed point. Transports own
+// their instance, feed it every sample they read and ask for a prediction
+// right before sending, so the horizon covers the exact age of the sample.
+class Predictor {
+public:
+    // Feed every sample of the stream, in order
+    void update(const Bno08x::Sample& sample);
+
+    // Orientation of the last sample, extrapolated to the given host time in
+    // microseconds. The horizon is capped to max_horizon.
+    Quat14 predict(int64_t target_time) const;
+
+    // Angular velocity in the sensor frame, rad/s in Q10
+    std::array<int16_t, 3> angular_velocity() const { return omega; }
+
+    // Extrapolation past this is more noise than signal, in microseconds
+    int64_t max_horizon = 100'000;
+
+private:
+    // Samples further apart than this don't give a meaningful velocity
+    static constexpr int64_t MAX_SAMPLE_GAP = 100'000;
+    // Smoothing of the estimated velocity, as a divisor
+    static constexpr int32_t SMOOTHING_DIV = 4;
+
+    bool has_last = false;
+    Quat14 last_rotation = Quat14::identity();
+    int64_t last_timestamp = 0;
+    std::array<int16_t, 3> omega{};
+};
+
+}  // namespace euler
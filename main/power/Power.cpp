@@ -0,0 +1,76 @@
+#include "Power.hpp"
+
+#include <driver/gpio.h>
+#include <esp_log.h>
+#include <esp_sleep.h>
+#include <sdkconfig.h>
+#include <soc/soc_caps.h>
+
+#include <cstdio>
+
+static const char *TAG = "Power";
+
+bool euler::power::init() {
+#if CONFIG_EULER_POWER_MANAGEMENT
+    esp_pm_config_t config = {};
+    config.max_freq_mhz = CONFIG_EULER_POWER_MAX_FREQ_MHZ;
+    config.min_freq_mhz = CONFIG_EULER_POWER_MIN_FREQ_MHZ;
+#if CONFIG_EULER_POWER_LIGHT_SLEEP
+    config.light_sleep_enable = true;
+#endif
+
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management with err: %d",
+                 err);
+        return false;
+    }
+
+    // Drivers pick their pins, see gpio_wakeup_enable()
+    err = esp_sleep_enable_gpio_wakeup();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable the GPIO wake up with err: %d", err);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "CPU clocked from %d to %d MHz, light sleep %s",
+             config.min_freq_mhz, config.max_freq_mhz,
+             config.light_sleep_enable ? "enabled" : "disabled");
+#endif
+
+    return true;
+}
+
+void euler::power::dump() {
+#if CONFIG_PM_PROFILING
+    // Time spent in every mode, and how long each lock was held
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+bool euler::power::deep_sleep(uint64_t wake_pins) {
+    // Wake up lines are active low, they idle on their pull ups
+    gpio_config_t config = {};
+    config.pin_bit_mask = wake_pins;
+    config.mode = GPIO_MODE_INPUT;
+    config.pull_up_en = GPIO_PULLUP_ENABLE;
+    config.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    config.intr_type = GPIO_INTR_DISABLE;
+    esp_err_t err = gpio_config(&config);
+    if (err == ESP_OK)
+        err = esp_deep_sleep_enable_gpio_wakeup(wake_pins,
+                                                ESP_GPIO_WAKEUP_GPIO_LOW);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable the deep sleep wake up with err: %d",
+                 err);
+        return false;
+    }
+
+#if !SOC_GPIO_SUPPORT_HOLD_SINGLE_IO_IN_DSLP
+    // Pins held with gpio_hold_en() only stay held with the global hold
+    gpio_deep_sleep_hold_en();
+#endif
+
+    ESP_LOGI(TAG, "Deep sleeping");
+    esp_deep_sleep_start();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <esp_pm.h>
+
+#include <cstdint>
+
+namespace euler::power {
+
+// Lets the CPU scale its frequency down, and the chip light sleep, whenever
+// nothing holds a lock, see EULER_POWER_MANAGEMENT. Wake up sources have to
+// be enabled by their drivers, GPIO ones with gpio_wakeup_enable().
+bool init();
+
+// Logs the time spent in every power mode and lock since boot, only with
+// CONFIG_PM_PROFILING
+void dump();
+
+// Deep sleeps until one of the given pins goes low, they are pulled up
+// meanwhile. Only LP IOs can wake the chip up, and outputs float unless held
+// with gpio_hold_en() beforehand. Returns only if the wake up could not be
+// set up.
+bool deep_sleep(uint64_t wake_pins);
+
+// Owns a PM lock, does nothing when power management is not available
+class Lock {
+public:
+    Lock() {}
+    Lock(const Lock&) = delete;
+    Lock(Lock&&) = delete;
+
+    bool init(esp_pm_lock_type_t type, const char* name) {
+        if (handle != nullptr) return false;
+        return esp_pm_lock_create(type, 0, name, &handle) == ESP_OK;
+    }
+
+    void acquire() {
+        if (handle != nullptr) esp_pm_lock_acquire(handle);
+    }
+
+    void release() {
+        if (handle != nullptr) esp_pm_lock_release(handle);
+    }
+
+private:
+    esp_pm_lock_handle_t handle = nullptr;
+};
+
+}  // namespace euler::power
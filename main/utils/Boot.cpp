@@ -0,0 +1,63 @@
+#include "Boot.hpp"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+static const char *TAG = "Boot";
+
+using namespace euler::boot;
+
+// Zero until reached
+static std::array<std::atomic<int64_t>, PHASE_COUNT> times{};
+
+void euler::boot::mark(Phase phase) {
+    std::atomic<int64_t> &time = times[size_t(phase)];
+    if (time.load(std::memory_order_relaxed) != 0) return;
+
+    // Phases reached as esp_timer starts still count as reached
+    int64_t expected = 0;
+    time.compare_exchange_strong(expected,
+                                 std::max<int64_t>(esp_timer_get_time(), 1),
+                                 std::memory_order_relaxed);
+}
+
+std::optional<int64_t> euler::boot::time(Phase phase) {
+    int64_t time = times[size_t(phase)].load(std::memory_order_relaxed);
+    if (time == 0) return std::nullopt;
+    return time;
+}
+
+void euler::boot::dump() {
+    ESP_LOGI(TAG, "Since the application started, without ROM and bootloader");
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        Phase phase = Phase(i);
+        if (auto reached = time(phase)) {
+            ESP_LOGI(TAG, "%-12s at %6lld us", phase_name(phase), *reached);
+        } else {
+            ESP_LOGI(TAG, "%-12s not reached", phase_name(phase));
+        }
+    }
+}
+
+const char *euler::boot::phase_name(Phase phase) {
+    switch (phase) {
+        case Phase::Init:
+            return "init";
+        case Phase::ImuQueued:
+            return "imu queued";
+        case Phase::ImuReady:
+            return "imu ready";
+        case Phase::Radio:
+            return "radio";
+        case Phase::InitDone:
+            return "init done";
+        case Phase::FirstSample:
+            return "first sample";
+    }
+
+    return "<unknown>";
+}
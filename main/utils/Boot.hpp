@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace euler::boot {
+
+// Milestones of the start up of the application. Some of them are reached
+// concurrently, the IMU boots while the radio starts. The ROM and the
+// bootloader run before esp_timer starts and are not covered.
+enum class Phase : uint8_t {
+    // Euler::init() entered, after the IDF start up
+    Init,
+    // Buses are up and the IMU commands are queued
+    ImuQueued,
+    // The IMU booted, or resumed from sleep
+    ImuReady,
+    // The Bluetooth host is running
+    Radio,
+    // Euler::init() returned
+    InitDone,
+    // The first orientation sample was published
+    FirstSample,
+};
+
+static constexpr size_t PHASE_COUNT = 6;
+
+// Records the time a phase was first reached, later calls are ignored. It is
+// cheap once recorded and can be called from any task.
+void mark(Phase phase);
+// Time at which a phase was reached, in microseconds since the application
+// started, as counted by esp_timer
+std::optional<int64_t> time(Phase phase);
+
+// Logs the phases reached so far, relative to the application start
+void dump();
+
+const char* phase_name(Phase phase);
+
+}  // namespace euler::boot
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+
+namespace euler {
+
+// Fixed point helpers, the MCU has no FPU so the sample path stays in the
+// Q formats the BNO08x reports in and only converts at the edges
+namespace fixed {
+
+static constexpr float to_float(int32_t value, int q) {
+    return float(value) * (1.0f / float(1 << q));
+}
+
+static constexpr int16_t saturate(int32_t value) {
+    if (value > INT16_MAX) return INT16_MAX;
+    if (value < INT16_MIN) return INT16_MIN;
+    return int16_t(value);
+}
+
+static constexpr int16_t from_float(float value, int q) {
+    float scaled = value * float(1 << q);
+    return saturate(int32_t(scaled < 0 ? scaled - 0.5f : scaled + 0.5f));
+}
+
+// Divide rounding to nearest, the divisor must be positive
+static constexpr int32_t div_round(int32_t num, int32_t den) {
+    return (num < 0 ? num - den / 2 : num + den / 2) / den;
+}
+
+// Floor of the square root
+static constexpr uint32_t isqrt(uint32_t value) {
+    uint32_t result = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > value) bit >>= 2;
+
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return result;
+}
+
+}  // namespace fixed
+
+// Quaternion with Q14 components, 1.0 is 16384. The kernels below use 32 bit
+// intermediates, which is safe as long as the norms stay below 2, a margin
+// any unit quaternion coming from the sensor has.
+struct Quat14 {
+    int16_t x, y, z, w;
+
+    static constexpr int Q = 14;
+    static constexpr int32_t ONE = 1 << Q;
+
+    static constexpr Quat14 identity() { return {0, 0, 0, ONE}; }
+
+    constexpr Quat14 conjugate() const {
+        return {fixed::saturate(-x), fixed::saturate(-y),
+                fixed::saturate(-z), w};
+    }
+
+    // Same rotation, opposite sign
+    constexpr Quat14 negated() const {
+        return {fixed::saturate(-x), fixed::saturate(-y),
+                fixed::saturate(-z), fixed::saturate(-w)};
+    }
+
+    // Squared norm, in Q28
+    constexpr uint32_t norm2() const {
+        return uint32_t(x * x) + uint32_t(y * y) + uint32_t(z * z) +
+               uint32_t(w * w);
+    }
+
+    // Hamilton product, a * b applies b first
+    static constexpr Quat14 multiply(Quat14 a, Quat14 b) {
+        int32_t x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+        int32_t y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+        int32_t z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+        int32_t w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+        return {round(x), round(y), round(z), round(w)};
+    }
+
+    // Rescale to unit norm, the zero quaternion maps to the identity
+    static constexpr Quat14 normalize(Quat14 q) {
+        uint32_t norm = fixed::isqrt(q.norm2());
+        if (norm == 0) return identity();
+
+        auto scale = [norm](int16_t c) {
+            return fixed::saturate(
+                fixed::div_round(int32_t(c) * ONE, int32_t(norm)));
+        };
+
+        return {scale(q.x), scale(q.y), scale(q.z), scale(q.w)};
+    }
+
+private:
+    // Q28 back to Q14, rounding to nearest
+    static constexpr int16_t round(int32_t value) {
+        return fixed::saturate((value + (1 << (Q - 1))) >> Q);
+    }
+};
+
+}  // namespace euler
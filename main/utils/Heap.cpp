@@ -0,0 +1,82 @@
+#include "Heap.hpp"
+
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sdkconfig.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <span>
+
+#include "Tasklet.hpp"
+
+static const char *TAG = "Heap";
+
+static std::atomic<bool> is_sealed{false};
+
+#if CONFIG_EULER_STATIC_HEAP
+// Firmware tasks, which may not allocate once sealed. Written before the
+// seal and only read after it.
+static constexpr size_t MAX_SEALED = 12;
+DRAM_ATTR static std::array<TaskHandle_t, MAX_SEALED> sealed_tasks;
+DRAM_ATTR static size_t sealed_count = 0;
+
+// Allocations of the other tasks since the seal
+DRAM_ATTR static std::atomic<uint32_t> late_allocations{0};
+
+// Called by the heap on every allocation, see CONFIG_HEAP_USE_HOOKS. It may
+// run with the cache disabled, and logging could allocate again.
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void *ptr, size_t size,
+                                                    uint32_t caps) {
+    if (!is_sealed.load(std::memory_order_acquire)) return;
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (size_t i = 0; i < sealed_count; i++) {
+        if (sealed_tasks[i] == task)
+            esp_system_abort(DRAM_STR("Heap allocation after init"));
+    }
+
+    late_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
+void euler::heap::dump() {
+    size_t total = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+    size_t free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    ESP_LOGI(TAG,
+             "%u of %u bytes used, least free: %u bytes, largest free block: "
+             "%u bytes",
+             total - free, total,
+             heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+             heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+#if CONFIG_EULER_STATIC_HEAP
+    if (sealed()) {
+        ESP_LOGI(TAG, "%lu allocations by the IDF and Bluetooth tasks since "
+                 "init", late_allocations.load(std::memory_order_relaxed));
+    }
+#endif
+}
+
+void euler::heap::seal() {
+#if CONFIG_EULER_STATIC_HEAP
+    sealed_tasks[0] = xTaskGetCurrentTaskHandle();
+    size_t tasklets = Tasklet::handles(
+        std::span{sealed_tasks}.subspan(1, MAX_SEALED - 1));
+    if (tasklets > MAX_SEALED - 1) {
+        ESP_LOGW(TAG, "Too many tasks, %u of them can still allocate",
+                 tasklets - (MAX_SEALED - 1));
+    }
+    sealed_count = 1 + std::min(tasklets, MAX_SEALED - 1);
+
+    ESP_LOGI(TAG, "Sealed, allocations from %u firmware tasks abort from now "
+             "on", sealed_count);
+#endif
+    is_sealed.store(true, std::memory_order_release);
+}
+
+bool euler::heap::sealed() { return is_sealed.load(std::memory_order_relaxed); }
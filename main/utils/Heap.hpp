@@ -0,0 +1,17 @@
+#pragma once
+
+namespace euler::heap {
+
+// Logs how much of the heap is used, the least that was ever free and the
+// largest free block, which shows fragmentation
+void dump();
+
+// Ends the init of the firmware tasks: the calling one and every tasklet
+// started so far, everything they keep is allocated by then. With
+// CONFIG_EULER_STATIC_HEAP any allocation they make from here on aborts, the
+// backtrace points at the caller. The IDF and Bluetooth tasks keep allocating
+// for connections, pairing and bond storage, dump() counts their allocations.
+void seal();
+bool sealed();
+
+}  // namespace euler::heap
@@ -0,0 +1,263 @@
+#include "Log.hpp"
+
+#include <freertos/FreeRTOS.h>
+#include <sdkconfig.h>
+#include <utils/Tasklet.hpp>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <span>
+
+using namespace euler::log;
+
+namespace {
+
+constexpr size_t QUEUE_LEN = 32;
+// Longest formatted message, longer ones are truncated
+constexpr size_t LINE_SIZE = 160;
+
+// Bounded ring of entries, any task can push and only the writer task pops.
+// There is a single core on the C6, so a per-core ring would be just this
+// one. Pushing takes no lock and no critical section, tasks race for a
+// position with a compare and swap and then own its slot.
+//
+// Every slot has a sequence number telling which lap of the ring it is at:
+// free for a position when it equals the start of the position's lap, filled
+// for it one past that. Counting relative to the slot index lets the ring
+// start out zeroed.
+class EntryRing {
+public:
+    // Returns false if the ring is full
+    bool push(const Entry& entry) {
+        uint32_t pos = tail.load(std::memory_order_relaxed);
+
+        while (true) {
+            Slot& slot = slots[pos % QUEUE_LEN];
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            int32_t diff = int32_t(seq - lap(pos));
+
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // Still holds the entry of the previous lap
+                return false;
+            } else {
+                // Another task took the position
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        Slot& slot = slots[pos % QUEUE_LEN];
+        slot.entry = entry;
+        slot.seq.store(lap(pos) + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only called from the writer task
+    bool pop(Entry& entry) {
+        if (!ready()) return false;
+
+        Slot& slot = slots[head % QUEUE_LEN];
+        entry = slot.entry;
+        slot.seq.store(lap(head) + QUEUE_LEN, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    bool ready() const {
+        const Slot& slot = slots[head % QUEUE_LEN];
+        return slot.seq.load(std::memory_order_acquire) == lap(head) + 1;
+    }
+
+private:
+    static_assert((QUEUE_LEN & (QUEUE_LEN - 1)) == 0,
+                  "Positions wrap around, the length must divide 2^32");
+
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        Entry entry;
+    };
+
+    static uint32_t lap(uint32_t pos) { return pos - pos % QUEUE_LEN; }
+
+    std::array<Slot, QUEUE_LEN> slots{};
+    std::atomic<uint32_t> tail{0};
+    uint32_t head = 0;
+};
+
+EntryRing ring;
+std::atomic<uint32_t> dropped{0};
+// Set by the writer task before it blocks, whoever clears it wakes it up
+std::atomic<bool> sleeping{false};
+std::atomic<TaskHandle_t> writer_task{nullptr};
+
+euler::StaticTasklet<3 * 1024> writer;
+
+char level_letter(esp_log_level_t level) {
+    switch (level) {
+        case ESP_LOG_ERROR:
+            return 'E';
+        case ESP_LOG_WARN:
+            return 'W';
+        case ESP_LOG_INFO:
+            return 'I';
+        case ESP_LOG_DEBUG:
+            return 'D';
+        default:
+            return 'V';
+    }
+}
+
+// Formats the raw arguments of an entry, one conversion at a time. Arguments
+// were widened to words, the length modifiers tell how many each one takes.
+void format(const Entry& entry, std::span<char> out) {
+    const char* fmt = entry.site->format;
+    size_t len = 0;
+    size_t arg = 0;
+
+    auto append = [&](const char* spec, auto value) {
+        if (len >= out.size()) return;
+        int n = std::snprintf(out.data() + len, out.size() - len, spec, value);
+        if (n > 0) len = std::min(out.size() - 1, len + n);
+    };
+    auto next = [&](bool wide) {
+        uint64_t value = arg < entry.argc ? entry.args[arg++] : 0;
+        if (wide && arg < entry.argc)
+            value |= uint64_t(entry.args[arg++]) << 32;
+        return value;
+    };
+
+    while (*fmt != '\0' && len + 1 < out.size()) {
+        if (*fmt != '%' || fmt[1] == '%') {
+            out[len++] = *fmt;
+            fmt += *fmt == '%' ? 2 : 1;
+            continue;
+        }
+
+        // Flags, width and precision are passed on as is
+        const char* start = fmt++;
+        while (*fmt != '\0' && std::strchr("-+ #0123456789.", *fmt)) fmt++;
+
+        int longs = 0;
+        while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z') {
+            if (*fmt == 'l') longs++;
+            fmt++;
+        }
+
+        char conversion = *fmt;
+        if (conversion == '\0') break;
+        fmt++;
+
+        std::array<char, 16> spec{};
+        size_t spec_len = std::min<size_t>(fmt - start, spec.size() - 1);
+        std::memcpy(spec.data(), start, spec_len);
+
+        bool is_signed = conversion == 'd' || conversion == 'i';
+        if (longs >= 2) {
+            uint64_t value = next(true);
+            if (is_signed) {
+                append(spec.data(), (long long)(int64_t(value)));
+            } else {
+                append(spec.data(), (unsigned long long)value);
+            }
+        } else if (longs == 1) {
+            uint64_t value = next(sizeof(long) > 4);
+            if (is_signed) {
+                append(spec.data(), sizeof(long) > 4 ? long(int64_t(value))
+                                                     : long(int32_t(value)));
+            } else {
+                append(spec.data(), (unsigned long)value);
+            }
+        } else {
+            uint32_t value = uint32_t(next(false));
+            if (is_signed || conversion == 'c') {
+                append(spec.data(), int(int32_t(value)));
+            } else {
+                append(spec.data(), unsigned(value));
+            }
+        }
+    }
+
+    out[std::min(len, out.size() - 1)] = '\0';
+}
+
+void write_entry(const Entry& entry) {
+    const Site& site = *entry.site;
+    if (site.level > esp_log_level_get(site.tag)) return;
+
+    uint32_t ms = uint32_t(entry.time / 1000);
+
+#if CONFIG_EULER_LOG_TOKENIZED
+    std::array<char, LINE_SIZE> line;
+    int len = std::snprintf(line.data(), line.size(), "@%08" PRIx32
+                            " %" PRIx32 " %" PRIx32,
+                            site.token, ms, entry.suppressed);
+    for (size_t i = 0; i < entry.argc && len < int(line.size()); i++) {
+        len += std::snprintf(line.data() + len, line.size() - len,
+                             " %" PRIx32, entry.args[i]);
+    }
+
+    esp_log_write(site.level, site.tag, "%s\n", line.data());
+#else
+    std::array<char, LINE_SIZE> message;
+    format(entry, message);
+
+    if (entry.suppressed > 0) {
+        esp_log_write(site.level, site.tag,
+                      "%c (%" PRIu32 ") %s: %s (%" PRIu32 " suppressed)\n",
+                      level_letter(site.level), ms, site.tag, message.data(),
+                      entry.suppressed);
+    } else {
+        esp_log_write(site.level, site.tag, "%c (%" PRIu32 ") %s: %s\n",
+                      level_letter(site.level), ms, site.tag, message.data());
+    }
+#endif
+}
+
+void writer_func() {
+    writer_task.store(xTaskGetCurrentTaskHandle());
+
+    while (1) {
+        Entry entry;
+        if (!ring.pop(entry)) {
+            // Either a task sees the flag after its push, or the entry it
+            // pushed is seen here
+            sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!ring.ready()) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            sleeping.store(false);
+            continue;
+        }
+
+        write_entry(entry);
+
+        if (uint32_t count = dropped.exchange(0, std::memory_order_relaxed)) {
+            esp_log_write(ESP_LOG_WARN, "Log",
+                          "W (%" PRIu32 ") Log: %" PRIu32
+                          " messages dropped, the queue was full\n",
+                          esp_log_timestamp(), count);
+        }
+    }
+}
+
+}  // namespace
+
+bool euler::log::init() {
+    return writer.start("Log", euler::Priority::Background, writer_func);
+}
+
+void euler::log::push(const Entry& entry) {
+    if (!ring.push(entry)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Only the first message after the writer ran out wakes it up
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false))
+        xTaskNotify(writer_task.load(), 0, eIncrement);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Deferred logging for the sample path. EULER_LOGx takes the same arguments as
+// ESP_LOGx, but the caller only copies a reference to the call site and the
+// raw arguments into a queue, a low priority task formats them later. Repeated
+// messages are rate limited per call site, the next one that goes through
+// tells how many were suppressed.
+//
+// Arguments are limited to integers and enums, the format is checked like a
+// printf one. With CONFIG_EULER_LOG_TOKENIZED the writer task doesn't format
+// anything either, it prints lines like:
+//   @<token> <time ms> <suppressed> <arguments>...
+// in hex, where the token is the FNV-1a hash of the format string.
+// tools/log_decode.py finds the formats in the sources and turns such output
+// back into text.
+namespace euler::log {
+
+static constexpr size_t MAX_ARGS = 6;
+// Messages let through per call site and per second
+static constexpr uint32_t RATE_LIMIT = 10;
+
+consteval uint32_t token(std::string_view format) {
+    uint32_t hash = 2166136261u;
+    for (char c : format) {
+        hash ^= uint8_t(c);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// State of a call site, one static instance per EULER_LOGx
+struct Site {
+    esp_log_level_t level;
+    const char* tag;
+    const char* format;
+    uint32_t token;
+
+    std::atomic<uint32_t> window{0};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> suppressed{0};
+};
+
+struct Entry {
+    const Site* site;
+    int64_t time;
+    uint32_t suppressed;
+    uint8_t argc;
+    std::array<uint32_t, MAX_ARGS> args;
+};
+
+// Starts the writer task, messages logged before are kept as long as they fit
+bool init();
+
+// Messages above this level are discarded by the caller, defaults to info.
+// The esp_log level of the tag applies on top of it when writing.
+inline std::atomic<esp_log_level_t> threshold{ESP_LOG_INFO};
+
+inline void set_level(esp_log_level_t level) {
+    threshold.store(level, std::memory_order_relaxed);
+}
+
+inline bool enabled(esp_log_level_t level) {
+    return level <= threshold.load(std::memory_order_relaxed);
+}
+
+// Never blocks, the message is dropped if the queue is full
+void push(const Entry& entry);
+
+template <typename T>
+concept Argument = std::integral<T> || std::is_enum_v<T>;
+
+template <Argument... Args>
+void write(Site& site, Args... args) {
+    int64_t now = esp_timer_get_time();
+
+    // Races between tasks logging from the same site only blur the limit
+    uint32_t second = uint32_t(now / 1'000'000);
+    if (site.window.exchange(second, std::memory_order_relaxed) != second)
+        site.count.store(0, std::memory_order_relaxed);
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= RATE_LIMIT) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Entry entry{.site = &site,
+                .time = now,
+                .suppressed =
+                    site.suppressed.exchange(0, std::memory_order_relaxed),
+                .argc = 0,
+                .args = {}};
+
+    // 64 bit arguments take two words, low first
+    [[maybe_unused]] auto add = [&](auto arg) {
+        uint64_t value = uint64_t(arg);
+        entry.args[entry.argc++] = uint32_t(value);
+        if constexpr (sizeof(arg) > 4)
+            entry.args[entry.argc++] = uint32_t(value >> 32);
+    };
+    static_assert(((sizeof(Args) > 4 ? 2 : 1) + ... + 0) <= MAX_ARGS,
+                  "Too many log arguments");
+    (add(args), ...);
+
+    push(entry);
+}
+
+// Never called, lets the compiler check the format against the arguments
+[[gnu::format(printf, 1, 2)]] inline void check_format(const char*, ...) {}
+
+}  // namespace euler::log
+
+#define EULER_LOG_LEVEL(level, tag, format, ...)                          \
+    do {                                                                  \
+        if (::euler::log::enabled(level)) {                               \
+            static ::euler::log::Site site_{                              \
+                level, tag, format, ::euler::log::token(format)};         \
+            ::euler::log::write(site_, ##__VA_ARGS__);                    \
+        }                                                                 \
+        if (false) ::euler::log::check_format(format, ##__VA_ARGS__);    \
+    } while (0)
+
+#define EULER_LOGE(tag, format, ...) \
+    EULER_LOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define EULER_LOGW(tag, format, ...) \
+    EULER_LOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define EULER_LOGI(tag, format, ...) \
+    EULER_LOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define EULER_LOGD(tag, format, ...) \
+    EULER_LOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace euler {
+
+// Fixed capacity, single producer, multiple consumer broadcast ring.
+//
+// The producer never blocks: once the ring is full the oldest entry gets
+// overwritten. Every consumer owns a Reader with its own cursor, so any number
+// of them can follow the same stream without knowing about each other. Slots
+// are protected by a per-slot sequence number (seqlock style), a reader that
+// races with the producer simply detects it and counts the entry as lost.
+template <typename T, size_t N>
+    requires(std::is_trivially_copyable_v<T> && N > 0 && (N & (N - 1)) == 0)
+class SampleRing {
+public:
+    class Reader {
+    public:
+        // Start reading from the next entry that will be published
+        explicit Reader(const SampleRing& ring)
+            : ring{&ring}, cursor{ring.head.load(std::memory_order_acquire)} {}
+
+        // Read the oldest entry not yet seen by this reader, returns false if
+        // there are no new entries
+        bool pop(T& out) {
+            while (true) {
+                uint32_t head = ring->head.load(std::memory_order_acquire);
+                if (head == cursor) return false;
+
+                // We got lapped by the producer, skip to the oldest entry
+                // still available
+                if (head - cursor > N) {
+                    lost += head - cursor - N;
+                    cursor = head - N;
+                }
+
+                if (ring->read(cursor++, out)) return true;
+
+                // The slot got overwritten while we were reading it
+                lost++;
+            }
+        }
+
+        // Read the most recent entry and mark everything before it as seen,
+        // returns false if there are no new entries
+        bool latest(T& out) {
+            while (true) {
+                uint32_t head = ring->head.load(std::memory_order_acquire);
+                if (head == cursor) return false;
+
+                // Skipping entries on purpose is not an overrun
+                cursor = head;
+                if (ring->read(head - 1, out)) return true;
+            }
+        }
+
+        // Number of entries available to pop right now, capped to the ring
+        // capacity
+        size_t available() const {
+            uint32_t count =
+                ring->head.load(std::memory_order_acquire) - cursor;
+            return count > N ? N : count;
+        }
+
+        // Number of entries this reader lost because it was too slow
+        uint32_t overruns() const { return lost; }
+
+        // Index of the next entry to be read, wraps around
+        uint32_t position() const { return cursor; }
+
+    private:
+        const SampleRing* ring;
+        uint32_t cursor;
+        uint32_t lost = 0;
+    };
+
+    SampleRing() {}
+    SampleRing(const SampleRing&) = delete;
+    SampleRing(SampleRing&&) = delete;
+
+    static constexpr size_t capacity() { return N; }
+
+    // Must only ever be called from a single producer
+    void publish(const T& value) {
+        uint32_t index = head.load(std::memory_order_relaxed);
+        Slot& slot = slots[index % N];
+
+        // Odd sequence numbers mark a slot as being written
+        slot.seq.store(index * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.value = value;
+
+        slot.seq.store(index * 2 + 2, std::memory_order_release);
+        head.store(index + 1, std::memory_order_release);
+    }
+
+    // Total number of entries ever published, wraps around
+    uint32_t published() const { return head.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        T value;
+    };
+
+    bool read(uint32_t index, T& out) const {
+        const Slot& slot = slots[index % N];
+
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != index * 2 + 2) return false;
+
+        out = slot.value;
+
+        // Make sure the copy is complete before checking the sequence again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    std::atomic<uint32_t> head{0};
+    Slot slots[N];
+};
+
+}  // namespace euler
@@ -0,0 +1,113 @@
+#include "Tasklet.hpp"
+
+#include <esp_timer.h>
+#include <sdkconfig.h>
+
+#include <atomic>
+
+static const char *TAG = "Tasklet";
+
+using namespace euler;
+
+// Every tasklet ever started, slots are never reused. A slot is reserved
+// through the count and filled in after, readers skip the empty ones.
+static constexpr size_t MAX_TASKLETS = 8;
+static std::array<std::atomic<Tasklet *>, MAX_TASKLETS> tasklets{};
+static std::atomic<size_t> tasklet_count{0};
+
+// Time of the last dump(), CPU use is relative to it
+static int64_t dumped_at = 0;
+
+bool Tasklet::create(const char *name, uint32_t stack_size, Priority priority,
+                     BaseType_t core) {
+    if (!static_stack.empty() && stack_size > static_stack.size_bytes()) {
+        ESP_LOGE(TAG, "Stack of %s is too small", name);
+        return false;
+    }
+
+    if (!static_stack.empty()) {
+        task = xTaskCreateStaticPinnedToCore(
+            task_fn, name, stack_size, this, UBaseType_t(priority),
+            static_stack.data(), static_tcb, core);
+    } else if (xTaskCreatePinnedToCore(task_fn, name, stack_size, this,
+                                       UBaseType_t(priority), &task,
+                                       core) != pdPASS) {
+        task = nullptr;
+    }
+
+    if (task == nullptr) {
+        ESP_LOGE(TAG, "Failed to create a new task");
+        return false;
+    }
+
+    this->name = name;
+    this->stack_size = stack_size;
+
+    size_t index = tasklet_count.fetch_add(1);
+    if (index < MAX_TASKLETS) {
+        // Publishes the fields set above along with the tasklet
+        tasklets[index].store(this, std::memory_order_release);
+    } else {
+        ESP_LOGW(TAG, "Too many tasklets, %s is not reported", name);
+    }
+
+    return true;
+}
+
+Tasklet::Stats Tasklet::stats() const {
+    Stats stats{.name = name,
+                .stack_size = stack_size,
+                .stack_free = std::nullopt,
+                .cpu_time = 0};
+    if (task == nullptr) return stats;
+
+#if INCLUDE_uxTaskGetStackHighWaterMark
+    stats.stack_free = uxTaskGetStackHighWaterMark(task);
+#endif
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    stats.cpu_time = ulTaskGetRunTimeCounter(task);
+#endif
+    return stats;
+}
+
+size_t Tasklet::handles(std::span<TaskHandle_t> out) {
+    size_t count = 0;
+    for (std::atomic<Tasklet *> &slot : tasklets) {
+        Tasklet *tasklet = slot.load(std::memory_order_acquire);
+        if (tasklet == nullptr) continue;
+
+        if (count < out.size()) out[count] = tasklet->task;
+        count++;
+    }
+    return count;
+}
+
+void Tasklet::dump() {
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed = now - dumped_at;
+    dumped_at = now;
+
+    for (std::atomic<Tasklet *> &slot : tasklets) {
+        Tasklet *started = slot.load(std::memory_order_acquire);
+        if (started == nullptr) continue;
+
+        Tasklet &tasklet = *started;
+        Stats stats = tasklet.stats();
+
+        // In tenths of a percent
+        uint32_t cpu_time = stats.cpu_time - tasklet.dumped_cpu_time;
+        tasklet.dumped_cpu_time = stats.cpu_time;
+        uint32_t load = elapsed > 0 ? cpu_time * 1000ull / elapsed : 0;
+
+        if (stats.stack_free) {
+            ESP_LOGI(TAG,
+                     "%-14s stack: %5lu of %5lu bytes used, cpu: %3lu.%lu%%",
+                     stats.name, stats.stack_size - *stats.stack_free,
+                     stats.stack_size, load / 10, load % 10);
+        } else {
+            ESP_LOGI(TAG,
+                     "%-14s stack: unknown use of %5lu bytes, cpu: %3lu.%lu%%",
+                     stats.name, stats.stack_size, load / 10, load % 10);
+        }
+    }
+}
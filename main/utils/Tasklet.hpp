@@ -3,40 +3,134 @@
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <new>
+#include <optional>
+#include <span>
+#include <type_traits>
 
 namespace euler {
 
+// Priority classes of the firmware tasks. The sample path preempts the
+// streaming to hosts, which preempts background work, the NimBLE tasks stay
+// above all of them.
+enum class Priority : UBaseType_t {
+    Background = 1,
+    Stream = 3,
+    Sensor = 5,
+};
+
 class Tasklet {
 public:
+    // Lets the scheduler pick the core
+    static constexpr BaseType_t ANY_CORE = tskNO_AFFINITY;
+
+    struct Stats {
+        const char *name;
+        // In bytes, free is the least there was since the task started. It
+        // is unknown without INCLUDE_uxTaskGetStackHighWaterMark.
+        uint32_t stack_size;
+        std::optional<uint32_t> stack_free;
+        // Run time counter of the task in microseconds, it wraps. Zero without
+        // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+        uint32_t cpu_time;
+    };
+
     Tasklet() {}
     Tasklet(const Tasklet &) = delete;
     Tasklet(Tasklet &&) = delete;
 
+    // The stack size is in bytes. The function is copied into the tasklet,
+    // it has to be small and trivially copyable, like a lambda capturing a
+    // pointer or two, so that starting a task never allocates.
     template <typename F>
         requires std::is_invocable_r_v<void, F>
-    bool start(const char *name, uint32_t stack, UBaseType_t priority, F func) {
+    bool start(const char *name, uint32_t stack_size, Priority priority, F func,
+               BaseType_t core = ANY_CORE) {
+        static_assert(sizeof(F) <= FUNC_SIZE && alignof(F) <= alignof(void *),
+                      "Tasklet function is too large");
+        static_assert(std::is_trivially_copyable_v<F> &&
+                          std::is_trivially_destructible_v<F>,
+                      "Tasklet function must be trivially copyable");
         if (task != nullptr) return false;
 
-        this->func = func;
-        if (xTaskCreate(task_fn, name, stack, this, priority, &task) !=
-            pdPASS) {
-            ESP_LOGE("Tasklet", "Failed to create a new task");
-            return false;
-        }
+        new (func_storage.data()) F{func};
+        func_invoke = [](void *func) { std::invoke(*static_cast<F *>(func)); };
+        return create(name, stack_size, priority, core);
+    }
+
+    TaskHandle_t handle() const { return task; }
 
-        return true;
+    // Ticks to block for a wait in microseconds. Rounds up and waits at least
+    // a tick: at 100 Hz most waits are shorter than a tick, and a timeout of
+    // zero returns right away and spins.
+    static constexpr TickType_t ticks_for(
+        int64_t us, int64_t tick_us = portTICK_PERIOD_MS * 1000) {
+        if (us <= tick_us) return 1;
+        return TickType_t((us + tick_us - 1) / tick_us);
     }
 
+    Stats stats() const;
+
+    // Logs the stack use of every tasklet, and their CPU use since the last
+    // call. Not thread safe, should be called from a single task.
+    static void dump();
+
+    // Fills in the handles of the tasklets started so far, returns how many
+    // there are, which may be more than fit
+    static size_t handles(std::span<TaskHandle_t> out);
+
 protected:
+    // For tasklets that bring their own storage, see StaticTasklet
+    Tasklet(std::span<StackType_t> stack, StaticTask_t &tcb)
+        : static_stack{stack}, static_tcb{&tcb} {}
+
     static void task_fn(void *arg) {
-        std::invoke(reinterpret_cast<Tasklet *>(arg)->func);
+        Tasklet *tasklet = reinterpret_cast<Tasklet *>(arg);
+        tasklet->func_invoke(tasklet->func_storage.data());
     }
 
     TaskHandle_t task = nullptr;
 
 private:
-    std::function<void()> func;
+    bool create(const char *name, uint32_t stack_size, Priority priority,
+                BaseType_t core);
+
+    static constexpr size_t FUNC_SIZE = 2 * sizeof(void *);
+
+    // Function given to start() and its type erased caller
+    alignas(void *) std::array<std::byte, FUNC_SIZE> func_storage;
+    void (*func_invoke)(void *func) = nullptr;
+
+    std::span<StackType_t> static_stack;
+    StaticTask_t *static_tcb = nullptr;
+
+    const char *name = nullptr;
+    uint32_t stack_size = 0;
+    // Run time counter at the last dump()
+    uint32_t dumped_cpu_time = 0;
+};
+
+// Tasklet with its stack and control block inside, nothing is allocated when
+// it starts. The stack size is in bytes.
+template <uint32_t STACK_SIZE>
+class StaticTasklet : public Tasklet {
+public:
+    StaticTasklet() : Tasklet{stack, tcb} {}
+
+    template <typename F>
+        requires std::is_invocable_r_v<void, F>
+    bool start(const char *name, Priority priority, F func,
+               BaseType_t core = ANY_CORE) {
+        return Tasklet::start(name, STACK_SIZE, priority, func, core);
+    }
+
+private:
+    std::array<StackType_t, STACK_SIZE / sizeof(StackType_t)> stack;
+    StaticTask_t tcb;
 };
 
-}  // namespace euler
\ No newline at end of file
+}  // namespace euler
@@ -0,0 +1,95 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+
+using namespace euler::trace;
+
+static std::array<Histogram, STAGE_COUNT> histograms;
+
+size_t Histogram::bucket_of(uint32_t duration) {
+    if (duration < SUB_BUCKETS) return duration;
+
+    // The top bits select the power of two, the next ones the linear bucket
+    int exp = 31 - __builtin_clz(duration);
+    uint32_t sub = (duration >> (exp - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (exp - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint32_t Histogram::bucket_max(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+
+    int exp = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    uint32_t sub = bucket % SUB_BUCKETS;
+    uint64_t min = uint64_t(SUB_BUCKETS + sub) << (exp - SUB_BITS);
+    return min + (uint64_t(1) << (exp - SUB_BITS)) - 1;
+}
+
+void Histogram::record(uint32_t duration) {
+    buckets[bucket_of(duration)].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t prev = peak.load(std::memory_order_relaxed);
+    while (duration > prev &&
+           !peak.compare_exchange_weak(prev, duration,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::reset() {
+    for (auto &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    peak.store(0, std::memory_order_relaxed);
+}
+
+uint32_t Histogram::count() const {
+    uint32_t total = 0;
+    for (const auto &bucket : buckets)
+        total += bucket.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint32_t Histogram::percentile(uint32_t permille) const {
+    uint32_t total = count();
+    if (total == 0) return 0;
+
+    // Rank of the wanted sample, rounded up
+    uint32_t rank = (uint64_t(total) * permille + 999) / 1000;
+    uint32_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) return std::min(bucket_max(i), max());
+    }
+
+    return max();
+}
+
+void euler::trace::record(Stage stage, uint32_t origin) {
+    histograms[size_t(stage)].record(now() - origin);
+}
+
+Summary euler::trace::summary(Stage stage) {
+    const Histogram &histogram = histograms[size_t(stage)];
+    return {.count = histogram.count(),
+            .p50 = histogram.percentile(500),
+            .p99 = histogram.percentile(990),
+            .max = histogram.max()};
+}
+
+void euler::trace::reset() {
+    for (auto &histogram : histograms) histogram.reset();
+}
+
+const char *euler::trace::stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::I2cStart:
+            return "i2c start";
+        case Stage::I2cEnd:
+            return "i2c end";
+        case Stage::Parse:
+            return "parse";
+        case Stage::Publish:
+            return "publish";
+        case Stage::Send:
+            return "send";
+    }
+
+    return "<unknown>";
+}
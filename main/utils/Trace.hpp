@@ -0,0 +1,73 @@
+#pragma once
+
+#include <esp_timer.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace euler::trace {
+
+// Points of the sample path, every stage is measured from the BNO interrupt
+// that started it
+enum class Stage : uint8_t {
+    I2cStart,
+    I2cEnd,
+    Parse,
+    Publish,
+    Send,
+};
+
+static constexpr size_t STAGE_COUNT = 5;
+
+// Stamp of the current time in microseconds, cheap enough to be read from
+// ISRs. It comes from the systimer, which keeps counting at the same rate
+// whatever the CPU frequency and through light sleep, unlike the cycle
+// counter. It wraps every 71 minutes, which is fine for latencies.
+inline uint32_t now() { return uint32_t(esp_timer_get_time()); }
+
+// Latency distribution of a stage, in microseconds. Percentiles are rounded
+// up to the histogram resolution, the max is exact.
+struct Summary {
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t max;
+};
+
+// Fixed bucket, log-linear histogram of durations: every power of two is
+// split in SUB_BUCKETS linear buckets, bounding the error to 1 / SUB_BUCKETS.
+// Recording is lock free and may happen from any task.
+class Histogram {
+public:
+    void record(uint32_t duration);
+    void reset();
+
+    uint32_t count() const;
+    uint32_t max() const { return peak.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the given fraction of the samples
+    uint32_t percentile(uint32_t permille) const;
+
+private:
+    static constexpr int SUB_BITS = 3;
+    static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr size_t BUCKETS = (32 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    static size_t bucket_of(uint32_t duration);
+    static uint32_t bucket_max(size_t bucket);
+
+    std::array<std::atomic<uint32_t>, BUCKETS> buckets{};
+    std::atomic<uint32_t> peak{0};
+};
+
+// Record that a stage was reached, origin is the now() of the interrupt
+void record(Stage stage, uint32_t origin);
+
+Summary summary(Stage stage);
+// Clear every histogram, recordings racing with this might be lost
+void reset();
+
+const char* stage_name(Stage stage);
+
+}  // namespace euler::trace
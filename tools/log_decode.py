@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Decodes the tokenized logs printed with CONFIG_EULER_LOG_TOKENIZED.
+
+Token lines look like "@<token> <time ms> <suppressed> <arguments>...", in hex,
+where the token is the FNV-1a hash of the format string. The formats are found
+by scanning the EULER_LOGx calls in the sources, everything else is passed
+through untouched:
+
+    idf.py monitor | tools/log_decode.py
+    tools/log_decode.py console.log
+"""
+
+import argparse
+import pathlib
+import re
+import sys
+
+CALL = re.compile(
+    r'EULER_LOG([EWID])\s*\(\s*(\w+)\s*,\s*((?:"(?:[^"\\]|\\.)*"\s*)+)')
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+TAG = re.compile(r'static\s+const\s+char\s*\*\s*TAG\s*=\s*"([^"]*)"')
+TOKEN = re.compile(r'@([0-9a-f]{8})((?: [0-9a-f]+)+)\s*$')
+CONVERSION = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z)?([diuxXoc%])')
+
+
+def fnv1a(text):
+    value = 2166136261
+    for byte in text.encode():
+        value = ((value ^ byte) * 16777619) & 0xffffffff
+    return value
+
+
+def unescape(literal):
+    return literal.encode().decode('unicode_escape')
+
+
+def scan(root):
+    """Maps tokens to (level, tag, format) for every call site"""
+    formats = {}
+    for path in sorted(root.rglob('*.[ch]pp')):
+        source = path.read_text()
+        tag = TAG.search(source)
+        for call in CALL.finditer(source):
+            fmt = ''.join(unescape(m) for m in LITERAL.findall(call.group(3)))
+            name = tag.group(1) if tag and call.group(2) == 'TAG' \
+                else call.group(2)
+            formats[fnv1a(fmt)] = (call.group(1), name, fmt)
+    return formats
+
+
+def render(fmt, words):
+    """Formats the raw words like the device does, long is 32 bit there"""
+    words = list(words)
+
+    def convert(match):
+        flags, length, conversion = match.groups()
+        if conversion == '%':
+            return '%'
+
+        value = words.pop(0) if words else 0
+        bits = 32
+        if length == 'll':
+            value |= (words.pop(0) if words else 0) << 32
+            bits = 64
+        if conversion in 'di' and value >= 1 << (bits - 1):
+            value -= 1 << bits
+        if conversion == 'u':
+            conversion = 'd'
+        return ('%' + flags + conversion) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def decode(line, formats):
+    match = TOKEN.search(line)
+    if match is None:
+        return line
+
+    token = int(match.group(1), 16)
+    time, suppressed, *words = (int(w, 16) for w in match.group(2).split())
+    if token not in formats:
+        return line
+
+    level, tag, fmt = formats[token]
+    text = f'{level} ({time}) {tag}: {render(fmt, words)}'
+    if suppressed:
+        text += f' ({suppressed} suppressed)'
+    return line[:match.start()] + text + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('input', nargs='?', type=argparse.FileType('r'),
+                        default=sys.stdin)
+    parser.add_argument('--sources', type=pathlib.Path,
+                        default=pathlib.Path(__file__).parent.parent / 'main',
+                        help='firmware sources to take the formats from')
+    args = parser.parse_args()
+
+    formats = scan(args.sources)
+    for line in args.input:
+        sys.stdout.write(decode(line, formats))
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()